@@ -0,0 +1,159 @@
+/*	gc_n64_usb : Gamecube or N64 controller to USB firmware
+	Copyright (C) 2007-2016  Raphael Assenat <raph@raphnet.net>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <avr/pgmspace.h>
+#include "axis.h"
+#include "config.h"
+
+/* Response curves (AXIS_CURVE_* minus one). Full deflection is 255. */
+static const unsigned char curves[AXIS_NUM_CURVES-1][256] PROGMEM = {
+	// AXIS_CURVE_SMOOTH: Squared. Finer control near the center.
+	{
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x01, 0x01, 0x01,
+		0x01, 0x01, 0x01, 0x01, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x03, 0x03, 0x03, 0x03, 0x04, 0x04,
+		0x04, 0x04, 0x05, 0x05, 0x05, 0x05, 0x06, 0x06, 0x06, 0x07, 0x07, 0x07, 0x08, 0x08, 0x08, 0x09,
+		0x09, 0x09, 0x0a, 0x0a, 0x0b, 0x0b, 0x0b, 0x0c, 0x0c, 0x0d, 0x0d, 0x0e, 0x0e, 0x0f, 0x0f, 0x10,
+		0x10, 0x11, 0x11, 0x12, 0x12, 0x13, 0x13, 0x14, 0x14, 0x15, 0x15, 0x16, 0x17, 0x17, 0x18, 0x18,
+		0x19, 0x1a, 0x1a, 0x1b, 0x1c, 0x1c, 0x1d, 0x1e, 0x1e, 0x1f, 0x20, 0x20, 0x21, 0x22, 0x23, 0x23,
+		0x24, 0x25, 0x26, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x2f, 0x30,
+		0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0x3e, 0x3f,
+		0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47, 0x49, 0x4a, 0x4b, 0x4c, 0x4d, 0x4e, 0x4f, 0x50,
+		0x51, 0x52, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5b, 0x5c, 0x5d, 0x5e, 0x5f, 0x61, 0x62, 0x63,
+		0x64, 0x66, 0x67, 0x68, 0x69, 0x6b, 0x6c, 0x6d, 0x6f, 0x70, 0x71, 0x73, 0x74, 0x75, 0x77, 0x78,
+		0x79, 0x7b, 0x7c, 0x7e, 0x7f, 0x80, 0x82, 0x83, 0x85, 0x86, 0x88, 0x89, 0x8b, 0x8c, 0x8e, 0x8f,
+		0x91, 0x92, 0x94, 0x95, 0x97, 0x98, 0x9a, 0x9b, 0x9d, 0x9e, 0xa0, 0xa2, 0xa3, 0xa5, 0xa6, 0xa8,
+		0xaa, 0xab, 0xad, 0xaf, 0xb0, 0xb2, 0xb4, 0xb5, 0xb7, 0xb9, 0xba, 0xbc, 0xbe, 0xc0, 0xc1, 0xc3,
+		0xc5, 0xc7, 0xc8, 0xca, 0xcc, 0xce, 0xcf, 0xd1, 0xd3, 0xd5, 0xd7, 0xd9, 0xda, 0xdc, 0xde, 0xe0,
+		0xe2, 0xe4, 0xe6, 0xe8, 0xe9, 0xeb, 0xed, 0xef, 0xf1, 0xf3, 0xf5, 0xf7, 0xf9, 0xfb, 0xfd, 0xff,
+	},
+	// AXIS_CURVE_AGGRESSIVE: Square root. Faster response near the center.
+	{
+		0x00, 0x10, 0x17, 0x1c, 0x20, 0x24, 0x27, 0x2a, 0x2d, 0x30, 0x32, 0x35, 0x37, 0x3a, 0x3c, 0x3e,
+		0x40, 0x42, 0x44, 0x46, 0x47, 0x49, 0x4b, 0x4d, 0x4e, 0x50, 0x51, 0x53, 0x54, 0x56, 0x57, 0x59,
+		0x5a, 0x5c, 0x5d, 0x5e, 0x60, 0x61, 0x62, 0x64, 0x65, 0x66, 0x67, 0x69, 0x6a, 0x6b, 0x6c, 0x6d,
+		0x6f, 0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77, 0x79, 0x7a, 0x7b, 0x7c, 0x7d, 0x7e, 0x7f,
+		0x80, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x87, 0x88, 0x89, 0x8a, 0x8b, 0x8c, 0x8d, 0x8e,
+		0x8f, 0x90, 0x91, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x97, 0x98, 0x99, 0x9a, 0x9b, 0x9c,
+		0x9c, 0x9d, 0x9e, 0x9f, 0xa0, 0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa4, 0xa5, 0xa6, 0xa7, 0xa7, 0xa8,
+		0xa9, 0xaa, 0xaa, 0xab, 0xac, 0xad, 0xad, 0xae, 0xaf, 0xb0, 0xb0, 0xb1, 0xb2, 0xb3, 0xb3, 0xb4,
+		0xb5, 0xb5, 0xb6, 0xb7, 0xb7, 0xb8, 0xb9, 0xba, 0xba, 0xbb, 0xbc, 0xbc, 0xbd, 0xbe, 0xbe, 0xbf,
+		0xc0, 0xc0, 0xc1, 0xc2, 0xc2, 0xc3, 0xc4, 0xc4, 0xc5, 0xc6, 0xc6, 0xc7, 0xc7, 0xc8, 0xc9, 0xc9,
+		0xca, 0xcb, 0xcb, 0xcc, 0xcc, 0xcd, 0xce, 0xce, 0xcf, 0xd0, 0xd0, 0xd1, 0xd1, 0xd2, 0xd3, 0xd3,
+		0xd4, 0xd4, 0xd5, 0xd6, 0xd6, 0xd7, 0xd7, 0xd8, 0xd9, 0xd9, 0xda, 0xda, 0xdb, 0xdc, 0xdc, 0xdd,
+		0xdd, 0xde, 0xde, 0xdf, 0xe0, 0xe0, 0xe1, 0xe1, 0xe2, 0xe2, 0xe3, 0xe4, 0xe4, 0xe5, 0xe5, 0xe6,
+		0xe6, 0xe7, 0xe7, 0xe8, 0xe9, 0xe9, 0xea, 0xea, 0xeb, 0xeb, 0xec, 0xec, 0xed, 0xed, 0xee, 0xee,
+		0xef, 0xf0, 0xf0, 0xf1, 0xf1, 0xf2, 0xf2, 0xf3, 0xf3, 0xf4, 0xf4, 0xf5, 0xf5, 0xf6, 0xf6, 0xf7,
+		0xf7, 0xf8, 0xf8, 0xf9, 0xf9, 0xfa, 0xfa, 0xfb, 0xfb, 0xfc, 0xfc, 0xfd, 0xfd, 0xfe, 0xfe, 0xff,
+	},
+};
+
+/* Factor bringing the span between the deadzone and the end of the
+ * range to 0-255, 8.8 fixed point. Recomputed when the span changes. */
+static unsigned char cached_span[GCN64_NUM_AXES];
+static unsigned short span_scale[GCN64_NUM_AXES];
+
+/*
+ * \brief Response stage: Range scaling, deadzone, curve and anti-deadzone
+ * \param i		The axis index (for its settings)
+ * \param value	The axis value
+ * \param center	The axis rest position
+ * \param range	Distance from the center reached at full deflection
+ *
+ * The distance from the center, starting past the deadzone, is scaled to
+ * 0-255, goes through the response curve, and is then scaled to the
+ * output range starting at the anti-deadzone.
+ */
+static unsigned char processAxis(unsigned char i, unsigned char value, unsigned char center, unsigned char range)
+{
+	unsigned char dz = g_config.axis_deadzone[i];
+	unsigned char adz = g_config.axis_antideadzone[i];
+	unsigned char curve = g_config.axis_curve[i];
+	unsigned char neg, d, span, limit;
+	unsigned short scaled;
+
+	if (range >= AXIS_MAX_RANGE && !dz && !adz && curve == AXIS_CURVE_LINEAR)
+		return value; // Nothing to do. Keep the full 0x00-0xff range.
+
+	neg = value < center;
+	d = neg ? center - value : value - center;
+	if (d <= dz)
+		return center;
+
+	if (range > dz) {
+		span = range - dz;
+		if (span != cached_span[i]) {
+			cached_span[i] = span;
+			// Rounded up, so d == range gives 255, not 254
+			span_scale[i] = (0xff00U + span - 1) / span;
+		}
+		scaled = ((unsigned long)(d - dz) * span_scale[i]) >> 8;
+		if (scaled > 255)
+			scaled = 255;
+	} else {
+		scaled = 255;
+	}
+
+	if (curve > AXIS_CURVE_LINEAR && curve < AXIS_NUM_CURVES) {
+		scaled = pgm_read_byte(&curves[curve-1][scaled]);
+	}
+
+	// 0x00 and 0xff are not the same distance from the center. Full
+	// deflection (255) must reach the one on its side exactly.
+	limit = neg ? center : 0xff - center;
+	if (adz > limit)
+		adz = limit;
+	d = adz + ((scaled * (limit + 1 - adz)) >> 8);
+
+	return neg ? center - d : center + d;
+}
+
+/*
+ * \brief Axis processing (response stage, then hysteresis)
+ * \param built		The axis values read from the controller. Modified in place.
+ * \param sent		The axis values most recently sent to the host
+ * \param num_axes	The number of axes in the report
+ * \param center	The axis rest position
+ * \param native_range	Distance from the center reached at full deflection by
+ * 						this type of controller. Used when Config.axis_range is 0.
+ *
+ * This must run before change detection. One LSB of jitter would
+ * otherwise be enough to send a (two packets) report at each poll,
+ * even with the controller at rest.
+ */
+void axis_filter(unsigned char *built, const unsigned char *sent, unsigned char num_axes, unsigned char center, unsigned char native_range)
+{
+	unsigned char i, v, d, range;
+
+	for (i=0; i<num_axes; i++) {
+		if (i < AXIS_FIRST_TRIGGER) {
+			range = g_config.axis_range[i] ? g_config.axis_range[i] : native_range;
+			v = processAxis(i, built[i], center, range);
+		} else {
+			v = built[i];
+		}
+
+		// Returning to the center or reaching the end of the
+		// range must always be reported.
+		if (v != center && v != 0x00 && v != 0xff) {
+			d = v > sent[i] ? v - sent[i] : sent[i] - v;
+			if (d <= g_config.axis_hysteresis[i])
+				v = sent[i];
+		}
+
+		built[i] = v;
+	}
+}
+
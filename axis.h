@@ -0,0 +1,21 @@
+#ifndef _axis_h__
+#define _axis_h__
+
+/* Response curves (see Config.axis_curve) */
+#define AXIS_CURVE_LINEAR		0
+#define AXIS_CURVE_SMOOTH		1
+#define AXIS_CURVE_AGGRESSIVE	2
+#define AXIS_NUM_CURVES			3
+
+/* Largest distance from the center a report axis can take */
+#define AXIS_MAX_RANGE			127
+
+/* Report axes from this one on (Rz, Slider) are the Gamecube L/R sliders.
+ * They rest at one end, not at the center, so the response stage
+ * (deadzone, range, curve, anti-deadzone) does not apply to them. */
+#define AXIS_FIRST_TRIGGER		4
+
+void axis_filter(unsigned char *built, const unsigned char *sent, unsigned char num_axes, unsigned char center, unsigned char native_range);
+
+#endif // _axis_h__
+
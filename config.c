@@ -0,0 +1,198 @@
+/*	gc_n64_usb : Gamecube or N64 controller to USB firmware
+	Copyright (C) 2007-2016  Raphael Assenat <raph@raphnet.net>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+#include <string.h>
+#include "config.h"
+#include "eeprom_map.h"
+
+/* The configuration is stored in EEPROM as records, each one written
+ * to the slot following the previous one to spread the wear. At boot,
+ * the valid record with the most recent sequence number is used. */
+#define CONFIG_SLOTS	8
+
+typedef struct {
+	unsigned char version;
+	unsigned char seq;
+	Config config;
+	unsigned char crc; // must be last
+} ConfigRecord;
+
+#define eeprom_records	((ConfigRecord *)EEPROM_CONFIG_ADDR)
+EEPROM_CHECK_FITS(config_fits, EEPROM_CONFIG_ADDR + CONFIG_SLOTS * sizeof(ConfigRecord) <= E2END + 1);
+
+Config g_config;
+
+/* Image of the most recent record. Also the write buffer. */
+static ConfigRecord record;
+static unsigned char cur_slot;
+static unsigned char write_remaining;
+
+static unsigned char recordCrc(const ConfigRecord *rec)
+{
+	const unsigned char *p = (const unsigned char *)rec;
+	unsigned char i, crc = 0;
+
+	for (i=0; i<sizeof(ConfigRecord)-1; i++) {
+		crc = _crc_ibutton_update(crc, p[i]);
+	}
+
+	return crc;
+}
+
+static char isValid(const Config *cfg)
+{
+	unsigned char i;
+
+	if (cfg->poll_period < 1)
+		return 0; // Back to back polls
+	if (cfg->gc_lr_analog > GC_LR_ANALOG_OFF)
+		return 0;
+	if ((cfg->flags & CFG_FLAG_FORCE_GAMECUBE) && (cfg->flags & CFG_FLAG_FORCE_KEYBOARD))
+		return 0;
+
+	for (i=0; i<GCN64_NUM_FAMILIES; i++) {
+		if (cfg->tx_timings[i] != GCN64_TIMINGS_N64 && cfg->tx_timings[i] != GCN64_TIMINGS_GC)
+			return 0;
+	}
+
+	for (i=0; i<GCN64_NUM_AXES; i++) {
+		if (cfg->axis_range[i] > AXIS_MAX_RANGE)
+			return 0;
+		if (cfg->axis_deadzone[i] > AXIS_MAX_RANGE)
+			return 0;
+		if (cfg->axis_antideadzone[i] > AXIS_MAX_RANGE)
+			return 0;
+		if (cfg->axis_curve[i] >= AXIS_NUM_CURVES)
+			return 0;
+	}
+
+	return 1;
+}
+
+/* Settings used outside of g_config */
+static void apply(void)
+{
+	gcn64_selectTimings(gcn64_getFamily());
+}
+
+void config_setDefaults(void)
+{
+	g_config.flags = DEFAULT_FLAGS;
+	g_config.poll_period = DEFAULT_POLL_PERIOD;
+	g_config.gc_lr_analog = DEFAULT_GC_LR_ANALOG;
+	memset(g_config.tx_timings, DEFAULT_TX_TIMINGS, GCN64_NUM_FAMILIES);
+	g_config.rumble_interval = DEFAULT_RUMBLE_INTERVAL;
+	memset(g_config.axis_range, DEFAULT_AXIS_RANGE, GCN64_NUM_AXES);
+	memset(g_config.axis_deadzone, DEFAULT_AXIS_DEADZONE, GCN64_NUM_AXES);
+	memset(g_config.axis_antideadzone, DEFAULT_AXIS_ANTIDEADZONE, GCN64_NUM_AXES);
+	memset(g_config.axis_curve, DEFAULT_AXIS_CURVE, GCN64_NUM_AXES);
+	memset(g_config.axis_hysteresis, DEFAULT_AXIS_HYSTERESIS, GCN64_NUM_AXES);
+	apply();
+}
+
+char config_set(const Config *cfg)
+{
+	if (!isValid(cfg))
+		return -1;
+
+	memcpy(&g_config, cfg, sizeof(Config));
+	apply();
+
+	return 0;
+}
+
+void config_init(void)
+{
+	unsigned char i, found = 0, seq = 0;
+
+	config_setDefaults();
+
+	// So the first save goes to slot 0
+	cur_slot = CONFIG_SLOTS - 1;
+
+	for (i=0; i<CONFIG_SLOTS; i++) {
+		eeprom_read_block(&record, &eeprom_records[i], sizeof(ConfigRecord));
+
+		if (record.version != CONFIG_VERSION)
+			continue;
+		if (record.crc != recordCrc(&record))
+			continue;
+		if (!isValid(&record.config))
+			continue;
+		if (found && (signed char)(record.seq - seq) <= 0)
+			continue;
+
+		found = 1;
+		seq = record.seq;
+		cur_slot = i;
+	}
+
+	if (found) {
+		eeprom_read_block(&record, &eeprom_records[cur_slot], sizeof(ConfigRecord));
+		config_set(&record.config);
+	} else {
+		record.seq = 0;
+		memcpy(&record.config, &g_config, sizeof(Config));
+	}
+}
+
+/* Schedule writing the record image to the next slot. */
+static void writeRecord(void)
+{
+	record.version = CONFIG_VERSION;
+	record.seq++;
+	record.crc = recordCrc(&record);
+
+	cur_slot++;
+	if (cur_slot >= CONFIG_SLOTS)
+		cur_slot = 0;
+
+	write_remaining = sizeof(ConfigRecord);
+}
+
+void config_save(void)
+{
+	memcpy(&record.config, &g_config, sizeof(Config));
+	writeRecord();
+}
+
+void config_saveTxTimings(unsigned char family, unsigned char timings)
+{
+	g_config.tx_timings[family] = timings;
+	record.config.tx_timings[family] = timings;
+	writeRecord();
+}
+
+/* Writing a byte takes 3.3ms, so writing a whole record at once
+ * would prevent calling usbPoll() in time. Instead, write one byte
+ * per call, when the EEPROM is ready. The CRC goes last, so an
+ * interrupted write leaves an invalid record and the previous one
+ * remains in use. */
+void config_doTasks(void)
+{
+	unsigned char ofs;
+
+	if (!write_remaining || !eeprom_is_ready())
+		return;
+
+	ofs = sizeof(ConfigRecord) - write_remaining;
+	eeprom_update_byte((unsigned char *)&eeprom_records[cur_slot] + ofs,
+						((unsigned char *)&record)[ofs]);
+	write_remaining--;
+}
+
@@ -0,0 +1,72 @@
+#ifndef _config_h__
+#define _config_h__
+
+#include "reportdesc.h"
+#include "gcn64_protocol.h"
+#include "axis.h"
+
+/* Bump when the Config structure changes. Records of other
+ * versions found in EEPROM are ignored. */
+#define CONFIG_VERSION				5
+
+/* Default values, used until something else is configured. */
+#define DEFAULT_AXIS_DEADZONE		0
+#define DEFAULT_AXIS_HYSTERESIS		0
+#define DEFAULT_AXIS_RANGE			0 // Controller specific
+#define DEFAULT_AXIS_ANTIDEADZONE	0
+#define DEFAULT_AXIS_CURVE			AXIS_CURVE_LINEAR
+#define DEFAULT_FLAGS				CFG_FLAG_AUTO_TIMINGS
+#define DEFAULT_POLL_PERIOD			50 // for 240 hz
+#define DEFAULT_GC_LR_ANALOG		GC_LR_ANALOG_AUTO
+#define DEFAULT_TX_TIMINGS			GCN64_TIMINGS_N64
+#define DEFAULT_RUMBLE_INTERVAL		16 // ms
+
+/* Flags */
+#define CFG_FLAG_COALESCE_BUTTONS	0x01 // Hold presses until reported (see gamecube.c)
+#define CFG_FLAG_NONSTOP_VIBRATION	0x02 // Vibrate all the time (debug)
+#define CFG_FLAG_WAIT_FOR_PAD		0x04 // Do not enumerate before a controller is found
+#define CFG_FLAG_FORCE_GAMECUBE		0x08 // Skip detection, assume a Gamecube controller
+#define CFG_FLAG_FORCE_KEYBOARD		0x10 // Skip detection, assume a Gamecube keyboard
+#define CFG_FLAG_AUTO_TIMINGS		0x20 // Switch transmit timings when polls keep failing
+#define CFG_FLAG_ADAPTIVE_DECODE	0x40 // Decode replies using a learned bit period
+#define CFG_FLAG_HISTORY			0x80 // Record the controller replies (WITH_HISTORY builds, see history.h)
+
+/* Gamecube L/R sliders */
+#define GC_LR_ANALOG_AUTO			0 // Disabled when L+R are held at detection
+#define GC_LR_ANALOG_ON				1
+#define GC_LR_ANALOG_OFF			2
+
+typedef struct {
+	unsigned char flags; // CFG_FLAG_*
+
+	/* Controller poll period, in Timer2 ticks (85.3us) minus one */
+	unsigned char poll_period;
+	unsigned char gc_lr_analog; // GC_LR_ANALOG_*
+	unsigned char tx_timings[GCN64_NUM_FAMILIES]; // GCN64_TIMINGS_*, per GCN64_FAMILY_*. Saved when automatically changed.
+	unsigned char rumble_interval; // Minimum time between N64 rumble pak writes, in milliseconds
+
+	/* Per-axis settings are in report order: X, Y, Rx, Ry, Rz, Slider.
+	 * Only the hysteresis applies to Rz and Slider (see AXIS_FIRST_TRIGGER). */
+	unsigned char axis_range[GCN64_NUM_AXES]; // Distance from the center at full deflection. 0: Controller specific.
+	unsigned char axis_deadzone[GCN64_NUM_AXES]; // Values this close to the center become the center
+	unsigned char axis_antideadzone[GCN64_NUM_AXES]; // Smallest distance from the center reported past the deadzone
+	unsigned char axis_curve[GCN64_NUM_AXES]; // AXIS_CURVE_*
+	unsigned char axis_hysteresis[GCN64_NUM_AXES]; // Changes this small (or smaller) are not reported
+} Config;
+
+extern Config g_config;
+
+void config_init(void);
+void config_setDefaults(void);
+
+/* Validate and apply a configuration. Returns -1 if invalid. (Not saved) */
+char config_set(const Config *cfg);
+
+/* Change and save the transmit timings of a family, leaving the other
+ * saved settings as they are, even if they were changed since. */
+void config_saveTxTimings(unsigned char family, unsigned char timings);
+void config_save(void);
+void config_doTasks(void);
+
+#endif // _config_h__
+
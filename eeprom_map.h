@@ -0,0 +1,21 @@
+#ifndef _eeprom_map_h__
+#define _eeprom_map_h__
+
+/* EEPROM layout
+ *
+ * Each module has an area at a fixed address. With EEMEM, addresses
+ * would depend on the link order and on the size of the other records,
+ * so a firmware update could move the serial number or the settings.
+ * A record may grow within its area. Records of a different format are
+ * detected (version, CRC) and ignored.
+ *
+ * The smallest EEPROM (ATmega8) is 512 bytes.
+ */
+#define EEPROM_SERIAL_ADDR		0x000 // serialno.c, 16 bytes
+#define EEPROM_REMAP_ADDR		0x010 // remap.c, 112 bytes
+#define EEPROM_CONFIG_ADDR		0x080 // config.c, up to the end
+
+/* Fails to compile if the condition is false */
+#define EEPROM_CHECK_FITS(name, cond)	typedef char name[(cond) ? 1 : -1]
+
+#endif // _eeprom_map_h__
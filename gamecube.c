@@ -23,6 +23,10 @@
 #include "gamecube.h"
 #include "reportdesc.h"
 #include "gcn64_protocol.h"
+#include "axis.h"
+#include "config.h"
+#include "remap.h"
+#include "stats.h"
 
 /*********** prototypes *************/
 static void gamecubeInit(void);
@@ -36,52 +40,123 @@ static unsigned char last_built_report[GCN64_REPORT_SIZE];
 /* What was most recently sent to the host */
 static unsigned char last_sent_report[GCN64_REPORT_SIZE];
 
+/* Buttons pressed since the last report was sent. With
+ * CFG_FLAG_COALESCE_BUTTONS, this makes sure a short tap between two
+ * host fetches is reported (press first, release in a later report)
+ * instead of being overwritten before it was ever sent. */
+static unsigned char latched_buttons[2];
+
+#define GC_AXIS_CENTER	0x80
+#define GC_AXIS_RANGE	AXIS_MAX_RANGE // historically reported as is
+
 static int gc_rumbling = 0;
 static int gc_analog_lr_disable = 0;
 
+/* Until set, GC_GETID is sent before each poll (see checkId()). Cleared
+ * when a poll fails. */
+static unsigned char id_ok;
+static unsigned char fix_attempts;
+#define MAX_FIX_ATTEMPTS	3
+
+/* Wired controllers need nothing. A Wavebird receiver must have received
+ * its controller (it may not be on yet) and be locked to it. Otherwise,
+ * another Wavebird on the same channel could take over. Once locked, the
+ * receiver ignores the others and only GC_GETSTATUS is needed.
+ *
+ * Receivers which do not lock after a few GC_FIX_ID (clones?) are polled
+ * like wired controllers. The GC_GETID sent by detection is enough for
+ * them to work.
+ */
+static char checkId(void)
+{
+	unsigned char tmpdata[3];
+	unsigned char count;
+
+	tmpdata[0] = GC_GETID;
+	count = gcn64_transaction(tmpdata, 1);
+	if (count != GC_GETID_REPLY_LENGTH) {
+		return 1;
+	}
+	gcn64_protocol_getBytes(0, 3, tmpdata);
+
+	if (!(tmpdata[0] & GC_ID0_WIRELESS) || (tmpdata[1] & GC_ID1_WIRELESS_FIXED)) {
+		id_ok = 1;
+		fix_attempts = 0;
+		return 0;
+	}
+
+	if (!(tmpdata[0] & GC_ID0_WIRELESS_RECEIVED)) {
+		return 0; // Controller off. Check again at the next poll.
+	}
+
+	if (fix_attempts >= MAX_FIX_ATTEMPTS) {
+		id_ok = 1;
+		return 0;
+	}
+	fix_attempts++;
+
+	tmpdata[0] = GC_FIX_ID;
+	tmpdata[1] = GC_ID1_WIRELESS_FIXED | (tmpdata[1] & GC_ID1_WIRELESS_ID_HI);
+	// tmpdata[2] is already the low ID byte
+	count = gcn64_transaction(tmpdata, 3);
+	if (count != GC_FIX_ID_REPLY_LENGTH) {
+		return 1;
+	}
+
+	if (gcn64_protocol_getByte(8) & GC_ID1_WIRELESS_FIXED) {
+		id_ok = 1;
+	}
+
+	return 0;
+}
+
 static void gamecubeInit(void)
 {
+	remap_load(REMAP_GAMECUBE);
+	id_ok = 0;
+	fix_attempts = 0;
+
 	if (0 == gamecubeUpdate()) {
 		unsigned char btns2;
 
 		btns2 = gcn64_protocol_getByte(8);
 
-		//if (gcn64_workbuf[GC_BTN_L] && gcn64_workbuf[GC_BTN_R]) {
-		if ((btns2 & 0x06) == 0x06) { // L + R
-			gc_analog_lr_disable = 1;
-		} else {
-			gc_analog_lr_disable = 0;
+		switch (g_config.gc_lr_analog)
+		{
+			case GC_LR_ANALOG_AUTO:
+				//if (gcn64_workbuf[GC_BTN_L] && gcn64_workbuf[GC_BTN_R]) {
+				if ((btns2 & 0x06) == 0x06) { // L + R
+					gc_analog_lr_disable = 1;
+				} else {
+					gc_analog_lr_disable = 0;
+				}
+				break;
+
+			case GC_LR_ANALOG_OFF:
+				gc_analog_lr_disable = 1;
+				break;
+
+			default:
+				gc_analog_lr_disable = 0;
+				break;
 		}
 	}
 }
 
 static char gamecubeUpdate(void)
 {
-	int i;
 	unsigned char tmp=0;
 	unsigned char tmpdata[8];	
 	unsigned char count;
-	unsigned char x,y,cx,cy,rtrig,ltrig,btns1,btns2,rb1,rb2;
+	unsigned char axes[GCN64_NUM_AXES];
+	unsigned char btns1,btns2,rb1,rb2;
+	unsigned short buttons;
 
-#if 1
-	/* Get ID command.
-	 *
-	 * If we don't do that, the wavebird does not work.
-	 *
-	 * 2015-12-08: RA:
-	 * 	In fact, calling gcn64_detectController at least
-	 * 	once is enough to "enable" the wavebird receiver. In any case,
-	 * 	the GET_STATUS commands below get answered. This means
-	 * 	this GET_ID command is in fact optional. Removing it
-	 * 	does not seem to do harm with my receiver at least. But
-	 * 	I will not risk changing what has been there for years.
-	 */
-	tmp = GC_GETID;
-	count = gcn64_transaction(&tmp, 1);
-	if (count != GC_GETID_REPLY_LENGTH) {
+	/* Get ID command, until the receiver is locked (Wavebird) or
+	 * known not to need it. Used to be sent before every poll. */
+	if (!id_ok && checkId()) {
 		return 1;
 	}
-#endif
 
 	tmpdata[0] = GC_GETSTATUS1;
 	tmpdata[1] = GC_GETSTATUS2;
@@ -89,6 +164,7 @@ static char gamecubeUpdate(void)
 
 	count = gcn64_transaction(tmpdata, 3);
 	if (count != GC_GETSTATUS_REPLY_LENGTH) {
+		id_ok = 0; // Receiver reset or controller changed?
 		return 1; // failure
 	}
 
@@ -118,41 +194,51 @@ static char gamecubeUpdate(void)
 	
 	btns1 = gcn64_protocol_getByte(0);
 	btns2 = gcn64_protocol_getByte(8);
-	x = gcn64_protocol_getByte(16);
-	y = gcn64_protocol_getByte(24);
-	cx = gcn64_protocol_getByte(32);
-	cy = gcn64_protocol_getByte(40);
-	ltrig = gcn64_protocol_getByte(48);
-	rtrig = gcn64_protocol_getByte(56);
-
-	/* Prepare button bits */
-	rb1 = rb2 = 0;
-	for (i=0; i<5; i++) // St Y X B A
-		rb1 |= (btns1 & (0x10 >> i)) ? (0x01<<i) : 0;
-	for (i=0; i<3; i++) // L R Z
-		rb1 |= (btns2 & (0x40 >> i)) ? (0x20<<i) : 0;
-	for (i=0; i<4; i++) // Up,Down,Right,Left
-		rb2 |= (btns2 & (0x08 >> i)) ? (0x01<<i) : 0;
+
+	/* Drop frames that do not respect the fixed bits. A USB interrupt
+	 * stretching a bit during reception could otherwise produce a
+	 * valid looking, but wrong, report.
+	 *
+	 * Note: Bit 2 is not checked. Other sources document it as the
+	 * 'get origin' flag, which may be set until the origin is
+	 * requested (command 0x41). This adapter never does that. */
+	if ((btns1 & GC_STATUS_ZERO_BITS) || !(btns2 & GC_STATUS_ONE_BITS)) {
+		return 1; // corrupted
+	}
+
+	/* X, Y, C-X, C-Y, L, R. The default remap table inverts the
+	 * Y axes and the sliders. */
+	for (tmp=0; tmp<GCN64_NUM_AXES; tmp++) {
+		axes[tmp] = gcn64_protocol_getByte(16 + tmp * 8);
+	}
 
 	if (gc_analog_lr_disable) {
-		ltrig = 0x7f;
-		rtrig = 0x7f;
+		axes[4] = 0x7f;
+		axes[5] = 0x7f;
 	}
 
+	/* Prepare button bits (see remap.c) */
+	buttons = remap_buttons(btns1, btns2);
+	rb1 = buttons;
+	rb2 = buttons >> 8;
+
 	last_built_report[0] = 1; // report ID
-	last_built_report[1] = x;
-	last_built_report[2] = y ^ 0xff;
-	last_built_report[3] = cx;
-	last_built_report[4] = cy ^ 0xff;
-	// Sliders value to decrease as pushed (v2.x behaviour)
-	last_built_report[5] = ltrig ^ 0xff;
-	last_built_report[6] = rtrig ^ 0xff;
-	last_built_report[7] = rb1;
-	last_built_report[8] = rb2;
+	remap_axes(axes, last_built_report+1);
+	if (g_config.flags & CFG_FLAG_COALESCE_BUTTONS) {
+		latched_buttons[0] |= rb1;
+		latched_buttons[1] |= rb2;
+	}
+
+	last_built_report[7] = rb1 | latched_buttons[0];
+	last_built_report[8] = rb2 | latched_buttons[1];
+
+	axis_filter(last_built_report+1, last_sent_report+1, GCN64_NUM_AXES, GC_AXIS_CENTER, GC_AXIS_RANGE);
 
 	return 0; // success
 }
 
+PROF_UPDATE_WRAPPER(gamecubeUpdate, PROF_GC_UPDATE)
+
 static char gamecubeProbe(void)
 {
 	if (0 == gamecubeUpdate())
@@ -172,6 +258,7 @@ static int gamecubeBuildReport(unsigned char *reportBuffer, int id)
 		memcpy(reportBuffer, last_built_report, GCN64_REPORT_SIZE);
 	
 	memcpy(last_sent_report, last_built_report, GCN64_REPORT_SIZE);	
+	latched_buttons[0] = latched_buttons[1] = 0;
 	return GCN64_REPORT_SIZE;
 }
 
@@ -180,10 +267,10 @@ static void gamecubeVibration(int value)
 	gc_rumbling = value;
 }
 
-static Gamepad GamecubeGamepad = {
+static const Gamepad GamecubeGamepad PROGMEM = {
 	.num_reports			= 1,
 	.init					= gamecubeInit,
-	.update					= gamecubeUpdate,
+	.update					= PROF_UPDATE(gamecubeUpdate),
 	.changed				= gamecubeChanged,
 	.buildReport			= gamecubeBuildReport,
 	.probe					= gamecubeProbe,
@@ -192,8 +279,11 @@ static Gamepad GamecubeGamepad = {
 
 Gamepad *gamecubeGetGamepad(void)
 {
-	GamecubeGamepad.reportDescriptor = (void*)gcn64_usbHidReportDescriptor;
-	GamecubeGamepad.reportDescriptorSize = getUsbHidReportDescriptor_size();
-	return &GamecubeGamepad;
+	memcpy_P(&g_gamepad, &GamecubeGamepad, sizeof(Gamepad));
+	g_gamepad.reportDescriptor = (void*)gcn64_usbHidReportDescriptor;
+	g_gamepad.reportDescriptorSize = getUsbHidReportDescriptor_size();
+	g_gamepad.reportDescriptorTail = (void*)gcn64_pidReportDescriptor;
+	g_gamepad.reportDescriptorTailSize = getPidReportDescriptor_size();
+	return &g_gamepad;
 }
 
@@ -1,4 +1,8 @@
+#ifndef _gamecube_h__
+#define _gamecube_h__
+
 #include "gamepad.h"
 
 Gamepad *gamecubeGetGamepad(void);
 
+#endif // _gamecube_h__
@@ -1,12 +1,29 @@
 #ifndef _gamepad_h__
 #define _gamepad_h__
 
+/* HID boot interface protocols (HID 1.11 section 4.3) */
+#define HID_BOOT_PROTOCOL_NONE		0
+#define HID_BOOT_PROTOCOL_KEYBOARD	1
+#define HID_BOOT_PROTOCOL_MOUSE		2
+
+/* Boot report sizes (HID 1.11 Appendix B) */
+#define HID_BOOT_KEYBOARD_REPORT_SIZE	8
+#define HID_BOOT_MOUSE_REPORT_SIZE		3
+
 typedef struct {
 	int num_reports;
 
+	/* If not HID_BOOT_PROTOCOL_NONE, the interface is declared
+	 * as boot interface and the report must follow the boot format. */
+	unsigned char bootProtocol;
+
 	int reportDescriptorSize;
 	void *reportDescriptor; // must be in flash
 
+	/* Optional. Sent after reportDescriptor. */
+	int reportDescriptorTailSize;
+	void *reportDescriptorTail; // must be in flash
+
 	int deviceDescriptorSize; // if 0, use default
 	void *deviceDescriptor; // must be in flash
 	
@@ -20,6 +37,11 @@ typedef struct {
 	char (*probe)(void); /* return true if found */
 } Gamepad;
 
+/* Only one controller is used at a time. The structures are kept in
+ * flash, and the *GetGamepad() functions copy the requested one here.
+ * This invalidates the pointer previously returned. */
+extern Gamepad g_gamepad;
+
 #endif // _gamepad_h__
 
 
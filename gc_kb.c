@@ -24,13 +24,15 @@
 #include "gc_kb.h"
 #include "gcn64_protocol.h"
 #include "hid_keycodes.h"
+#include "stats.h"
 
 /*********** prototypes *************/
 static void gamecubeInit(void);
 static char gamecubeUpdate(void);
 static char gamecubeChanged(int rid);
 
-#define GC_KB_REPORT_SIZE	3
+#define GC_KB_REPORT_SIZE	HID_BOOT_KEYBOARD_REPORT_SIZE
+#define GC_KB_NUM_KEYS		3 // Keycodes in the Gamecube reply
 
 /* What was most recently read from the controller */
 static unsigned char last_built_report[GC_KB_REPORT_SIZE];
@@ -38,41 +40,48 @@ static unsigned char last_built_report[GC_KB_REPORT_SIZE];
 /* What was most recently sent to the host */
 static unsigned char last_sent_report[GC_KB_REPORT_SIZE];
 
-/* [0] Modifier byte
- * [1] Key array
+/* Standard boot protocol keyboard report (HID 1.11 Appendix B.1)
+ *
+ * [0] Modifier byte
+ * [1] Reserved
  * [2] Key array
  * [3] Key array
+ * [4] Key array
+ * [5] Key array
+ * [6] Key array
+ * [7] Key array
  *
  * See Universal Serial Bus HID Tables - 10 Keyboard/Keypad Page (0x07)
  * for key codes.
  *
+ * The report is 8 bytes, so it still fits in a single low speed packet.
  */
 static const unsigned char gcKeyboardReport[] PROGMEM = {
 	0x05, 0x01, // Usage page : Generic Desktop
 	0x09, 0x06, // Usage (Keyboard)
 	0xA1, 0x01, // Collection (Application)
 		0x05, 0x07, // Usage Page (Key Codes)
-/*		0x19, 0xE0, // Usage Minimum (224)
+		0x19, 0xE0, // Usage Minimum (224)
 		0x29, 0xE7, // Usage Maximum (231)
 		0x15, 0x00, // Logical Minimum (0)
 		0x25, 0x01, // Logical Maximum (1)
-		
+
 			// Modifier Byte
 		0x75, 0x01, // Report Size(1)
 		0x95, 0x08, // Report Count(8)
-		0x81, 0x02, // Input (Data, Variable, Absolute)*/
+		0x81, 0x02, // Input (Data, Variable, Absolute)
 
 			// Reserved Byte
-//		0x95, 0x01, // Report Count(1)
-//		0x75, 0x08, // Report Size(8)
+		0x95, 0x01, // Report Count(1)
+		0x75, 0x08, // Report Size(8)
+		0x81, 0x01, // Input (Constant)
 
-		0x95, 0x03, // Report Count(3)
+		0x95, 0x06, // Report Count(6)
 		0x75, 0x08, // Report Size(8)
 		0x15, 0x00, // Logical Minimum (0)
 		0x25, 0xE7, // Logical maximum (231)
 
 			// Key array
-//		0x05, 0x07, // Usage Page (key Codes)
 		0x19, 0x00, // Usage Minimum(0)
 		0x29, 0xE7, // Usage Maximum(231)
 		0x81, 0x00, // Input (Data, Array)
@@ -99,73 +108,111 @@ static const unsigned char gcKeyboardDevDesc[] PROGMEM = {    /* USB device desc
 
 // http://www2d.biglobe.ne.jp/~msyk/keyboard/layout/usbkeycode.html
 
-static const unsigned char gc_to_hid_table[] PROGMEM = {
-	GC_KEY_RESERVED,		HID_KB_NOEVENT,
-	GC_KEY_HOME,			HID_KB_HOME,
-	GC_KEY_END,				HID_KB_END,
-	GC_KEY_PGUP,			HID_KB_PGUP,
-	GC_KEY_PGDN,			HID_KB_PGDN,
-	GC_KEY_SCROLL_LOCK,		HID_KB_SCROLL_LOCK,
-	GC_KEY_DASH_UNDERSCORE, HID_KB_DASH_UNDERSCORE,
-	GC_KEY_PLUS_EQUAL,		HID_KB_EQUAL_PLUS,
-	GC_KEY_YEN,				HID_KB_INTERNATIONAL3,
-	GC_KEY_OPEN_BRKT_BRACE,	HID_KB_OPEN_BRKT_BRACE,
-	GC_KEY_SEMI_COLON_COLON,HID_KB_SEMI_COLON_COLON,
-	GC_KEY_QUOTES,			HID_KB_QUOTES,
-	GC_KEY_CLOSE_BRKT_BRACE,HID_KB_CLOSE_BRKT_BRACE,
-	GC_KEY_BRACKET_MU,		HID_KB_NONUS_HASH_TILDE,
-	GC_KEY_COMMA_ST,		HID_KB_COMMA_SMALLER_THAN,
-	GC_KEY_PERIOD_GT,		HID_KB_PERIOD_GREATER_THAN,
-	GC_KEY_SLASH_QUESTION,	HID_KB_SLASH_QUESTION,
-	GC_KEY_INTERNATIONAL1,	HID_KB_INTERNATIONAL1,
-	GC_KEY_ESC,				HID_KB_ESCAPE,
-	GC_KEY_INSERT,			HID_KB_INSERT,
-	GC_KEY_DELETE,			HID_KB_DELETE_FORWARD,
-	GC_KEY_HANKAKU,			HID_KB_GRAVE_ACCENT_AND_TILDE,
-	GC_KEY_BACKSPACE,		HID_KB_BACKSPACE,
-	GC_KEY_TAB,				HID_KB_TAB,
-	GC_KEY_CAPS_LOCK,		HID_KB_CAPS_LOCK,
-	GC_KEY_MUHENKAN,		HID_KB_INTERNATIONAL5,
-	GC_KEY_SPACE,			HID_KB_SPACE,
-	GC_KEY_HENKAN,			HID_KB_INTERNATIONAL4,
-	GC_KEY_KANA,			HID_KB_INTERNATIONAL2,
-	GC_KEY_LEFT,			HID_KB_LEFT_ARROW,
-	GC_KEY_DOWN,			HID_KB_DOWN_ARROW,
-	GC_KEY_UP,				HID_KB_UP_ARROW,
-	GC_KEY_RIGHT,			HID_KB_RIGHT_ARROW,
-	GC_KEY_ENTER,			HID_KB_ENTER,
+/* Indexed by Gamecube keycode. Unknown keys become the HID /? key. */
+static const unsigned char gc_to_hid_table[256] PROGMEM = {
+	[0 ... 255] = HID_KB_SLASH_QUESTION,
+
+	[GC_KEY_A] = HID_KB_A,
+	[GC_KEY_B] = HID_KB_B,
+	[GC_KEY_C] = HID_KB_C,
+	[GC_KEY_D] = HID_KB_D,
+	[GC_KEY_E] = HID_KB_E,
+	[GC_KEY_F] = HID_KB_F,
+	[GC_KEY_G] = HID_KB_G,
+	[GC_KEY_H] = HID_KB_H,
+	[GC_KEY_I] = HID_KB_I,
+	[GC_KEY_J] = HID_KB_J,
+	[GC_KEY_K] = HID_KB_K,
+	[GC_KEY_L] = HID_KB_L,
+	[GC_KEY_M] = HID_KB_M,
+	[GC_KEY_N] = HID_KB_N,
+	[GC_KEY_O] = HID_KB_O,
+	[GC_KEY_P] = HID_KB_P,
+	[GC_KEY_Q] = HID_KB_Q,
+	[GC_KEY_R] = HID_KB_R,
+	[GC_KEY_S] = HID_KB_S,
+	[GC_KEY_T] = HID_KB_T,
+	[GC_KEY_U] = HID_KB_U,
+	[GC_KEY_V] = HID_KB_V,
+	[GC_KEY_W] = HID_KB_W,
+	[GC_KEY_X] = HID_KB_X,
+	[GC_KEY_Y] = HID_KB_Y,
+	[GC_KEY_Z] = HID_KB_Z,
+
+	[GC_KEY_1] = HID_KB_1,
+	[GC_KEY_2] = HID_KB_2,
+	[GC_KEY_3] = HID_KB_3,
+	[GC_KEY_4] = HID_KB_4,
+	[GC_KEY_5] = HID_KB_5,
+	[GC_KEY_6] = HID_KB_6,
+	[GC_KEY_7] = HID_KB_7,
+	[GC_KEY_8] = HID_KB_8,
+	[GC_KEY_9] = HID_KB_9,
+	[GC_KEY_0] = HID_KB_0,
+
+	[GC_KEY_F1] = HID_KB_F1,
+	[GC_KEY_F2] = HID_KB_F2,
+	[GC_KEY_F3] = HID_KB_F3,
+	[GC_KEY_F4] = HID_KB_F4,
+	[GC_KEY_F5] = HID_KB_F5,
+	[GC_KEY_F6] = HID_KB_F6,
+	[GC_KEY_F7] = HID_KB_F7,
+	[GC_KEY_F8] = HID_KB_F8,
+	[GC_KEY_F9] = HID_KB_F9,
+	[GC_KEY_F10] = HID_KB_F10,
+	[GC_KEY_F11] = HID_KB_F11,
+	[GC_KEY_F12] = HID_KB_F12,
+
+	[GC_KEY_RESERVED] = HID_KB_NOEVENT,
+	[GC_KEY_HOME] = HID_KB_HOME,
+	[GC_KEY_END] = HID_KB_END,
+	[GC_KEY_PGUP] = HID_KB_PGUP,
+	[GC_KEY_PGDN] = HID_KB_PGDN,
+	[GC_KEY_SCROLL_LOCK] = HID_KB_SCROLL_LOCK,
+	[GC_KEY_DASH_UNDERSCORE] = HID_KB_DASH_UNDERSCORE,
+	[GC_KEY_PLUS_EQUAL] = HID_KB_EQUAL_PLUS,
+	[GC_KEY_YEN] = HID_KB_INTERNATIONAL3,
+	[GC_KEY_OPEN_BRKT_BRACE] = HID_KB_OPEN_BRKT_BRACE,
+	[GC_KEY_SEMI_COLON_COLON] = HID_KB_SEMI_COLON_COLON,
+	[GC_KEY_QUOTES] = HID_KB_QUOTES,
+	[GC_KEY_CLOSE_BRKT_BRACE] = HID_KB_CLOSE_BRKT_BRACE,
+	[GC_KEY_BRACKET_MU] = HID_KB_NONUS_HASH_TILDE,
+	[GC_KEY_COMMA_ST] = HID_KB_COMMA_SMALLER_THAN,
+	[GC_KEY_PERIOD_GT] = HID_KB_PERIOD_GREATER_THAN,
+	[GC_KEY_SLASH_QUESTION] = HID_KB_SLASH_QUESTION,
+	[GC_KEY_INTERNATIONAL1] = HID_KB_INTERNATIONAL1,
+	[GC_KEY_ESC] = HID_KB_ESCAPE,
+	[GC_KEY_INSERT] = HID_KB_INSERT,
+	[GC_KEY_DELETE] = HID_KB_DELETE_FORWARD,
+	[GC_KEY_HANKAKU] = HID_KB_GRAVE_ACCENT_AND_TILDE,
+	[GC_KEY_BACKSPACE] = HID_KB_BACKSPACE,
+	[GC_KEY_TAB] = HID_KB_TAB,
+	[GC_KEY_CAPS_LOCK] = HID_KB_CAPS_LOCK,
+	[GC_KEY_MUHENKAN] = HID_KB_INTERNATIONAL5,
+	[GC_KEY_SPACE] = HID_KB_SPACE,
+	[GC_KEY_HENKAN] = HID_KB_INTERNATIONAL4,
+	[GC_KEY_KANA] = HID_KB_INTERNATIONAL2,
+	[GC_KEY_LEFT] = HID_KB_LEFT_ARROW,
+	[GC_KEY_DOWN] = HID_KB_DOWN_ARROW,
+	[GC_KEY_UP] = HID_KB_UP_ARROW,
+	[GC_KEY_RIGHT] = HID_KB_RIGHT_ARROW,
+	[GC_KEY_ENTER] = HID_KB_ENTER,
 
 	/* "shift" keys */
-	GC_KEY_LEFT_SHIFT,		HID_KB_LEFT_SHIFT,
-	GC_KEY_RIGHT_SHIFT,		HID_KB_RIGHT_SHIFT,
-	GC_KEY_LEFT_CTRL,		HID_KB_LEFT_CONTROL,
+	[GC_KEY_LEFT_SHIFT] = HID_KB_LEFT_SHIFT,
+	[GC_KEY_RIGHT_SHIFT] = HID_KB_RIGHT_SHIFT,
+	[GC_KEY_LEFT_CTRL] = HID_KB_LEFT_CONTROL,
 
 	/* This keyboard only has a left alt key. But as right alt is required to access some
 	 * functions on japanese keyboards, I map the key to right alt.
 	 *
 	 * eg: RO-MAJI on the hiragana/katakana key */
-	GC_KEY_LEFT_ALT,		HID_KB_RIGHT_ALT,
+	[GC_KEY_LEFT_ALT] = HID_KB_RIGHT_ALT,
 };
 
 unsigned char gcKeycodeToHID(unsigned char gc_code)
 {
-	int i;
-
-	if (gc_code >= GC_KEY_A && gc_code <= GC_KEY_0) {
-		// Note: This works since A-Z, 1-9, 0 have consecutive keycode values.
-		return (gc_code - GC_KEY_A) + HID_KB_A;
-	}
-	if (gc_code >= GC_KEY_F1 && gc_code <= GC_KEY_F12) {
-		return (gc_code - GC_KEY_F1) + HID_KB_F1;
-	}
-
-	for (i=0; i<sizeof(gc_to_hid_table); i++) {
-		if (pgm_read_byte(gc_to_hid_table + i*2) == gc_code) {
-			return pgm_read_byte(gc_to_hid_table + i*2 + 1);
-		}
-	}
-
-	return 0x38; // HID /? key for unknown keys
+	return pgm_read_byte(gc_to_hid_table + gc_code);
 }
 
 static void gamecubeInit(void)
@@ -176,25 +223,44 @@ static char gamecubeUpdate(void)
 {
 	unsigned char tmpdata[8];	
 	unsigned char count;
+	unsigned char i, slot, hid;
 
 	tmpdata[0] = GC_POLL_KB1;
 	tmpdata[1] = GC_POLL_KB2;
 	tmpdata[2] = GC_POLL_KB3;
 
 	count = gcn64_transaction(tmpdata, 3);
-	if (count != 64) {
+	if (count != GC_POLL_KB_REPLY_LENGTH) {
 		return 1; // failure
 	}
 
 	gcn64_protocol_getBytes(0, 8, tmpdata);
 
-	last_built_report[0] = gcKeycodeToHID(tmpdata[4]);
-	last_built_report[1] = gcKeycodeToHID(tmpdata[5]);
-	last_built_report[2] = gcKeycodeToHID(tmpdata[6]);
+	/* Drop corrupted frames instead of reporting phantom keys */
+	if (tmpdata[7] != GC_KB_CHECKSUM(tmpdata)) {
+		return 1;
+	}
+
+	/* Modifier keys go in the bitmap, others fill the key array. The
+	 * Gamecube reply has 3 slots, so the last 3 array entries stay 0. */
+	memset(last_built_report, 0, GC_KB_REPORT_SIZE);
+	for (i=0, slot=2; i<GC_KB_NUM_KEYS; i++) {
+		hid = gcKeycodeToHID(tmpdata[4+i]);
+		if (hid == HID_KB_NOEVENT)
+			continue;
+
+		if (hid >= HID_KB_LEFT_CONTROL) {
+			last_built_report[0] |= 1 << (hid - HID_KB_LEFT_CONTROL);
+		} else {
+			last_built_report[slot++] = hid;
+		}
+	}
 
 	return 0; // success
 }
 
+PROF_UPDATE_WRAPPER(gamecubeUpdate, PROF_GC_KB_UPDATE)
+
 static char gamecubeProbe(void)
 {
 	if (0 == gamecubeUpdate())
@@ -217,21 +283,23 @@ static int gamecubeBuildReport(unsigned char *reportBuffer, int id)
 	return GC_KB_REPORT_SIZE;
 }
 
-static Gamepad GamecubeGamepad = {
+static const Gamepad GamecubeGamepad PROGMEM = {
 	.num_reports			= 1,
 	.init					= gamecubeInit,
-	.update					= gamecubeUpdate,
+	.update					= PROF_UPDATE(gamecubeUpdate),
 	.changed				= gamecubeChanged,
 	.buildReport			= gamecubeBuildReport,
 	.probe					= gamecubeProbe,
+	.bootProtocol			= HID_BOOT_PROTOCOL_KEYBOARD,
 };
 
 Gamepad *gc_kb_getGamepad(void)
 {
-	GamecubeGamepad.reportDescriptor = (void*)gcKeyboardReport;
-	GamecubeGamepad.reportDescriptorSize = sizeof(gcKeyboardReport);
-	GamecubeGamepad.deviceDescriptor = (void*)gcKeyboardDevDesc;
-	GamecubeGamepad.deviceDescriptorSize = sizeof(gcKeyboardDevDesc);
-	return &GamecubeGamepad;
+	memcpy_P(&g_gamepad, &GamecubeGamepad, sizeof(Gamepad));
+	g_gamepad.reportDescriptor = (void*)gcKeyboardReport;
+	g_gamepad.reportDescriptorSize = sizeof(gcKeyboardReport);
+	g_gamepad.deviceDescriptor = (void*)gcKeyboardDevDesc;
+	g_gamepad.deviceDescriptorSize = sizeof(gcKeyboardDevDesc);
+	return &g_gamepad;
 }
 
@@ -1,4 +1,8 @@
+#ifndef _gc_kb_h__
+#define _gc_kb_h__
+
 #include "gamepad.h"
 
 Gamepad *gc_kb_getGamepad(void);
 
+#endif // _gc_kb_h__
@@ -18,9 +18,8 @@
 #include <util/delay.h>
 
 #include "gcn64_protocol.h"
-
-#undef FORCE_KEYBOARD
-#undef FORCE_GAMECUBE
+#include "config.h"
+#include "stats.h"
 
 // I have a MadCatz micro-con contorller which misbehaves when
 // N64 timing (3/1 ratio) is used. None of my N64 controllers
@@ -28,9 +27,14 @@
 // easily updatable, I won't take the risk of changing a parameter
 // that has been constant for years.
 //
-// But the option is there for those of you who are going to compile
-// the project and are willing to change this.
-#undef GAMECUBE_TIMINGS // If not defined, use N64 timings
+// So N64 timings are still used by default. But both variants are
+// built in. Each controller family has its own setting, and when polls
+// keep failing with one, main.c tries the other (CFG_FLAG_AUTO_TIMINGS).
+static unsigned char tx_timings = GCN64_TIMINGS_N64;
+static unsigned char tx_family = GCN64_FAMILY_N64;
+
+// Set when the last transaction got no reply at all
+static unsigned char unanswered;
 
 #define GCN64_BUF_SIZE	300
 static volatile unsigned char gcn64_workbuf[GCN64_BUF_SIZE];
@@ -89,11 +93,14 @@ unsigned char gcn64_protocol_getByte(int offset)
 void gcn64_protocol_getBytes(int offset, int n_bytes, unsigned char *dstbuf)
 {
 	int i;
+	PROF_START(t);
 
 	for (i=0; i<n_bytes; i++) {
 		*dstbuf = gcn64_protocol_getByte(offset + (i*8));
 		dstbuf++;
 	}
+
+	PROF_END(PROF_GET_BYTES, t);
 }
 
 // The bit timeout is a counter to 127. This is the 
@@ -102,6 +109,10 @@ void gcn64_protocol_getBytes(int offset, int n_bytes, unsigned char *dstbuf)
 // "hangs in there" much longer than necessary..
 #define TIMING_OFFSET	100 // gives about 12uS. Twice the expected maximum bit period.
 
+/* Host builds (see host/) replace the data line functions
+ * below by a simulation. */
+#ifndef HOST_BUILD
+
 static unsigned char gcn64_receive()
 {
 	register unsigned char count=0;
@@ -170,6 +181,171 @@ static unsigned char gcn64_receive()
 	return count;
 }
 
+/* \brief Receive a reply, decoding each bit as it arrives
+ * \return The number of bits received (0 on timeout)
+ *
+ * gcn64_receive() stores two level durations per bit and counts them in
+ * 8 bits, which limits replies to 127 bits. The 264 bits of an expansion
+ * read reply would not fit. Here, each bit is compared as soon as its
+ * high level ends, like in gcn64_decodeWorkbuf() (a short low is a 1),
+ * and the workbuf gets one byte per bit. Counting is done by the
+ * pointer, so up to GCN64_BUF_SIZE bits can be received.
+ *
+ * Comparing takes about 10 cycles once the line is low again, which is
+ * taken from the next low level. The low count starts one step later
+ * to make up for it.
+ */
+static int gcn64_receiveBits(void)
+{
+	unsigned char volatile *ptr = gcn64_workbuf;
+
+	asm volatile(
+		"	clr r16					\n"
+"rb_initial_wait_low%=:\n"
+		"	inc r16					\n"
+		"	breq rb_done%=			\n" // overflow to 0
+		"	sbic %1, 5				\n"
+		"	rjmp rb_initial_wait_low%=	\n"
+
+		"	ldi r16, %2				\n"
+"rb_waithigh_lp%=:\n"
+		"	inc r16					\n"
+		"	brmi rb_done%=			\n" // > 127
+		"	sbis %1, 5				\n"
+		"	rjmp rb_waithigh_lp%=	\n"
+		"	mov r17, r16			\n" // low level duration
+
+		"	ldi r16, %2				\n"
+"rb_waitlow_lp%=:\n"
+		"	inc r16					\n"
+		"	brmi rb_done%=			\n" // > 127: The stop bit. Not stored.
+		"	sbic %1, 5				\n"
+		"	rjmp rb_waitlow_lp%=	\n"
+
+		"	cp r17, r16				\n" // carry set if low < high
+		"	sbc r17, r17			\n" // 0xff: 1, 0x00: 0
+		"	st z+, r17				\n"
+		"	ldi r16, %2 + 1			\n"
+		"	cpi r30, lo8(%3)		\n"
+		"	ldi r17, hi8(%3)		\n"
+		"	cpc r31, r17			\n"
+		"	brne rb_waithigh_lp%=	\n" // Stop when the workbuf is full
+"rb_done%=:\n"
+		:	"+z" (ptr)							// %0
+		:	"I" (_SFR_IO_ADDR(GCN64_DATA_PIN)),	// %1
+			"M" (TIMING_OFFSET),				// %2
+			"i" (gcn64_workbuf + GCN64_BUF_SIZE)	// %3
+		:	"r16", "r17"
+	);
+
+	return ptr - gcn64_workbuf;
+}
+
+// the value of the gpio is pre-configured to low. We simulate
+// an open drain output by toggling the direction.
+#define PULL_DATA		"	sbi %0, 5               \n"
+#define RELEASE_DATA	"	cbi %0, 5               \n"
+
+// busy looping delays based on busy loop and nop tuning.
+// valid for 12Mhz clock.
+
+// Gamecube timings (3.6/1.5us)
+#define GC_DLY_SHORT_1ST	"ldi r17, 2\n rcall sb_dly%=\nnop\nnop\n "
+#define GC_DLY_LARGE_1ST	"ldi r17, 11\n rcall sb_dly%=\nnop\n"
+#define GC_DLY_SHORT_2ND	"nop\nnop\nnop\nnop\nnop\n"
+#define GC_DLY_LARGE_2ND	"ldi r17, 7\n rcall sb_dly%=\n nop\nnop\n"
+
+// N64 timings (3/1us)
+#define N64_DLY_SHORT_1ST	"ldi r17, 1\n rcall sb_dly%=\n "
+#define N64_DLY_LARGE_1ST	"ldi r17, 9\n rcall sb_dly%=\n"
+#define N64_DLY_SHORT_2ND	"\n" 
+#define N64_DLY_LARGE_2ND	"ldi r17, 5\n rcall sb_dly%=\n nop\nnop\n"
+
+#define SEND_BITS_ASM(bits, DLY_SHORT_1ST, DLY_LARGE_1ST, DLY_SHORT_2ND, DLY_LARGE_2ND) \
+	asm volatile( \
+	/* Save the modified input operands */ \
+	"	push r28			\n" /* y */ \
+	"	push r29			\n" \
+	"	push r30			\n" /* z */ \
+	"	push r31			\n" \
+ \
+	"sb_loop%=:				\n" \
+	"	ld r16, z+			\n" \
+	"	tst r16				\n" \
+	"	breq sb_send0%=		\n" \
+	"	brne sb_send1%=		\n" \
+ \
+	"	rjmp sb_end%=		\n" /* not reached */ \
+ \
+ \
+	"sb_send0%=:			\n" \
+	"	nop					\n" \
+	PULL_DATA \
+	DLY_LARGE_1ST \
+	RELEASE_DATA \
+	DLY_SHORT_2ND \
+	"	sbiw	%1, 1		\n" \
+	"	brne sb_loop%=		\n" \
+	"	rjmp sb_end%=		\n" \
+ \
+	"sb_send1%=:			\n" \
+	PULL_DATA \
+	DLY_SHORT_1ST \
+	RELEASE_DATA \
+	DLY_LARGE_2ND \
+	"	sbiw	%1, 1		\n" \
+	"	brne sb_loop%=		\n" \
+	"	rjmp sb_end%=		\n" \
+ \
+	/* delay sub (arg r17) */ \
+	"sb_dly%=:				\n" \
+	"	dec r17				\n" \
+	"	brne sb_dly%=		\n" \
+	"	ret					\n" \
+ \
+ \
+	"sb_end%=:\n" \
+	/* going here is fast so we need to extend the last */ \
+	/* delay by 500nS */ \
+	"	nop\n " \
+	"	pop r31				\n" \
+	"	pop r30				\n" \
+	"	pop r29				\n" \
+	"	pop r28				\n" \
+	PULL_DATA \
+	DLY_SHORT_1ST \
+	RELEASE_DATA \
+ \
+	/* Now, we need to loop until the wire is high to */ \
+	/* prevent the reception code from thinking this is */ \
+	/* the beginning of the first reply bit. */ \
+ \
+	"	ldi r16, 0xff		\n" /* setup a timeout */ \
+	"sb_waitHigh%=:			\n" \
+	"	dec r16				\n" /* decrement timeout */ \
+	"	breq sb_wait_high_done%=		\n" /* handle timeout condition */ \
+	"	sbis %3, 5			\n" /* Read the port */ \
+	"	rjmp sb_waitHigh%=	\n" \
+"sb_wait_high_done%=:\n" \
+	: \
+	: "I" (_SFR_IO_ADDR(GCN64_DATA_DDR)), /* %0 */ \
+	  "w" (bits),						/* %1 */ \
+	  "z" ((unsigned char volatile *)gcn64_workbuf),					/* %2 */ \
+	  "I" (_SFR_IO_ADDR(GCN64_DATA_PIN))	/* %3 */ \
+	: "r16", "r17")
+
+/* Both variants are built in. The one in use is selected
+ * at runtime (see gcn64_selectTimings) */
+static void gcn64_sendBits_n64(unsigned int bits)
+{
+	SEND_BITS_ASM(bits, N64_DLY_SHORT_1ST, N64_DLY_LARGE_1ST, N64_DLY_SHORT_2ND, N64_DLY_LARGE_2ND);
+}
+
+static void gcn64_sendBits_gc(unsigned int bits)
+{
+	SEND_BITS_ASM(bits, GC_DLY_SHORT_1ST, GC_DLY_LARGE_1ST, GC_DLY_SHORT_2ND, GC_DLY_LARGE_2ND);
+}
+
 static void gcn64_sendBytes(unsigned char *data, unsigned char n_bytes)
 {
 	unsigned int bits;
@@ -183,98 +359,15 @@ static void gcn64_sendBytes(unsigned char *data, unsigned char n_bytes)
 	if (!bits)
 		return;
 
-	// the value of the gpio is pre-configured to low. We simulate
-	// an open drain output by toggling the direction.
-#define PULL_DATA		"	sbi %0, 5               \n"
-#define RELEASE_DATA	"	cbi %0, 5               \n"
-
-	// busy looping delays based on busy loop and nop tuning.
-	// valid for 12Mhz clock.
-#ifdef GAMECUBE_TIMINGS // (3.6/1.5us)
-#define DLY_SHORT_1ST	"ldi r17, 2\n rcall sb_dly%=\nnop\nnop\n "
-#define DLY_LARGE_1ST	"ldi r17, 11\n rcall sb_dly%=\nnop\n"
-#define DLY_SHORT_2ND	"nop\nnop\nnop\nnop\nnop\n"
-#define DLY_LARGE_2ND	"ldi r17, 7\n rcall sb_dly%=\n nop\nnop\n"
-#warning USING GAMECUBE TIMINGS
-#else // N64 timings (3/1us)
-#define DLY_SHORT_1ST	"ldi r17, 1\n rcall sb_dly%=\n "
-#define DLY_LARGE_1ST	"ldi r17, 9\n rcall sb_dly%=\n"
-#define DLY_SHORT_2ND	"\n" 
-#define DLY_LARGE_2ND	"ldi r17, 5\n rcall sb_dly%=\n nop\nnop\n"
-#endif
-	asm volatile(
-	// Save the modified input operands
-	"	push r28			\n" // y
-	"	push r29			\n"
-	"	push r30			\n" // z
-	"	push r31			\n"
-
-	"sb_loop%=:				\n"
-	"	ld r16, z+			\n"
-	"	tst r16				\n"
-	"	breq sb_send0%=		\n"
-	"	brne sb_send1%=		\n"
-
-	"	rjmp sb_end%=		\n" // not reached
-
-
-	"sb_send0%=:			\n"
-	"	nop					\n"
-	PULL_DATA
-	DLY_LARGE_1ST
-	RELEASE_DATA
-	DLY_SHORT_2ND
-	"	sbiw	%1, 1		\n"
-	"	brne sb_loop%=		\n"
-	"	rjmp sb_end%=		\n"
-
-	"sb_send1%=:			\n"
-	PULL_DATA
-	DLY_SHORT_1ST
-	RELEASE_DATA
-	DLY_LARGE_2ND
-	"	sbiw	%1, 1		\n"
-	"	brne sb_loop%=		\n"
-	"	rjmp sb_end%=		\n"
-
-// delay sub (arg r17)
-	"sb_dly%=:				\n"
-	"	dec r17				\n"
-	"	brne sb_dly%=		\n"
-	"	ret					\n"
-	
-
-	"sb_end%=:\n"
-	// going here is fast so we need to extend the last
-	// delay by 500nS
-	"	nop\n "
-	"	pop r31				\n"
-	"	pop r30				\n"
-	"	pop r29				\n"
-	"	pop r28				\n"
-	PULL_DATA
-	DLY_SHORT_1ST
-	RELEASE_DATA
-
-	// Now, we need to loop until the wire is high to 
-	// prevent the reception code from thinking this is
-	// the beginning of the first reply bit.
-
-	"	ldi r16, 0xff		\n" // setup a timeout
-	"sb_waitHigh%=:			\n"
-	"	dec r16				\n" // decrement timeout
-	"	breq sb_wait_high_done%=		\n" // handle timeout condition
-	"	sbis %3, 5			\n" // Read the port
-	"	rjmp sb_waitHigh%=	\n"
-"sb_wait_high_done%=:\n"
-	:
-	: "I" (_SFR_IO_ADDR(GCN64_DATA_DDR)), // %0
-	  "w" (bits),						// %1
-	  "z" ((unsigned char volatile *)gcn64_workbuf),					// %2
-	  "I" (_SFR_IO_ADDR(GCN64_DATA_PIN))	// %3
-	: "r16", "r17");
+	if (tx_timings == GCN64_TIMINGS_GC) {
+		gcn64_sendBits_gc(bits);
+	} else {
+		gcn64_sendBits_n64(bits);
+	}
 }
 
+#endif // HOST_BUILD
+
 /* \brief Decode the received length of low/high states to byte-per-bit format
  *
  * The result is in workbuf.
@@ -312,6 +405,10 @@ static void gcn64_decodeWorkbuf(unsigned char count)
     // No64 us = microseconds
 
 	// This operation takes approximately 100uS on 64bit gamecube messages
+	//
+	// count is the number of levels, two per bit plus the stop bit.
+	// Going further would read past the end of workbuf.
+	count /= 2;
 	for (i=0; i<count; i++) {
 		t = *input; 
 		input++;
@@ -323,6 +420,83 @@ static void gcn64_decodeWorkbuf(unsigned char count)
 	}
 }
 
+/* Number of bits used to learn the bit period */
+#define LEARN_BITS	8
+
+/* \brief Alternative decoder for off-spec controllers
+ *
+ * The bit period is learned from the first byte of the reply. Each bit
+ * is then classified by comparing its low time to half the learned period.
+ * Like in gcn64_decodeWorkbuf(), a short low time is a 1.
+ *
+ * Bits with a low time within 1/8 of a period from the threshold are
+ * counted as marginal (see g_stats.marginal_bits).
+ *
+ * Comparisons are made on 16 times the low time against the sum of
+ * LEARN_BITS periods, to avoid divisions.
+ **/
+static void gcn64_decodeWorkbuf_adaptive(unsigned char count)
+{
+	unsigned char i, bits;
+	volatile unsigned char *output = gcn64_workbuf;
+	volatile unsigned char *input = gcn64_workbuf;
+	unsigned int sum, margin, low, d;
+
+	bits = (count - 1) / 2;
+	if (bits < LEARN_BITS) {
+		// Too short to learn from
+		gcn64_decodeWorkbuf(count);
+		return;
+	}
+
+	for (i=0, sum=0; i<LEARN_BITS*2; i++) {
+		sum += input[i] - TIMING_OFFSET;
+	}
+	margin = sum / 4;
+
+	for (i=0; i<bits; i++) {
+		low = (*input - TIMING_OFFSET) * 16;
+		input += 2;
+
+		*output = low < sum;
+		output++;
+
+		d = low > sum ? low - sum : sum - low;
+		if (d < margin) {
+			g_stats.marginal_bits++;
+		}
+	}
+}
+
+void gcn64_selectTimings(unsigned char family)
+{
+	tx_family = family;
+	tx_timings = g_config.tx_timings[family];
+}
+
+unsigned char gcn64_getFamily(void)
+{
+	return tx_family;
+}
+
+void gcn64_toggleTimings(void)
+{
+	tx_timings = (tx_timings == GCN64_TIMINGS_N64) ?
+					GCN64_TIMINGS_GC : GCN64_TIMINGS_N64;
+}
+
+unsigned char gcn64_getTimings(void)
+{
+	return tx_timings;
+}
+
+/* Unlike a corrupted reply, no reply at all
+ * usually means the controller is gone. */
+unsigned char gcn64_lastTransactionUnanswered(void)
+{
+	return unanswered;
+}
+
 void gcn64protocol_hwinit(void)
 {
 	// data as input
@@ -352,8 +526,10 @@ int gcn64_transaction(unsigned char *data_out, int data_out_len)
 
 	gcn64_sendBytes(data_out, data_out_len);
 	count = gcn64_receive();
-	if (!count)
+	unanswered = !count;
+	if (!count) {
 		return 0;
+	}
 
 	if (!(count & 0x01)) {
 		// If we don't get an odd number of level lengths from gcn64_receive
@@ -365,7 +541,15 @@ int gcn64_transaction(unsigned char *data_out, int data_out_len)
 		return 0;
 	}
 
-	gcn64_decodeWorkbuf(count);
+	{
+		PROF_START(t);
+		if (g_config.flags & CFG_FLAG_ADAPTIVE_DECODE) {
+			gcn64_decodeWorkbuf_adaptive(count);
+		} else {
+			gcn64_decodeWorkbuf(count);
+		}
+		PROF_END(PROF_DECODE, t);
+	}
 	
 	/* this delay is required on N64 controllers. Otherwise, after sending
 	 * a rumble-on or rumble-off command (probably init too), the following
@@ -376,6 +560,26 @@ int gcn64_transaction(unsigned char *data_out, int data_out_len)
 	return (count-1) / 2;
 }
 
+/**
+ * \brief Like gcn64_transaction(), for replies longer than 127 bits.
+ * \return The number of bits received, 0 on timeout.
+ *
+ * Bits are decoded while receiving (see gcn64_receiveBits), so
+ * CFG_FLAG_ADAPTIVE_DECODE does not apply.
+ */
+int gcn64_transactionBits(unsigned char *data_out, int data_out_len)
+{
+	int count;
+
+	gcn64_sendBytes(data_out, data_out_len);
+	count = gcn64_receiveBits();
+	unanswered = !count;
+
+	_delay_us(5); // see gcn64_transaction()
+
+	return count;
+}
+
 
 #if (GC_GETID != 	N64_GET_CAPABILITIES)
 #error N64 vs GC detection commnad broken
@@ -419,6 +623,11 @@ int gcn64_detectController(void)
 	 * 0000 0101 0000 0000 0000 0001 : 0x050001 With expansion pack
 	 * 0000 0101 0000 0000 0000 0010 : 0x050002 Expansion pack removed
 	 *
+	 * -- N64 mouse (NUS-005)
+	 * 0000 0010 0000 0000 0000 0000 : 0x020000
+	 * (Device type 0x0200 in the Joybus device lists. The third byte
+	 * is the pak status, unused by the mouse.)
+	 *
 	 * -- Ascii keyboard (keyboard connector)
 	 * 0000 1000 0010 0000 0000 0000 : 0x082000
 	 *
@@ -450,17 +659,21 @@ int gcn64_detectController(void)
 
 	id = gcn64_protocol_getByte(0)<<8;
 	id |= gcn64_protocol_getByte(8);
-#ifdef FORCE_GAMECUBE
-	return CONTROLLER_IS_GC;
-#endif
-#ifdef FORCE_KEYBOARD
-	return CONTROLLER_IS_GC_KEYBOARD;
-#endif
+	if (g_config.flags & CFG_FLAG_FORCE_GAMECUBE)
+		return CONTROLLER_IS_GC;
+	if (g_config.flags & CFG_FLAG_FORCE_KEYBOARD)
+		return CONTROLLER_IS_GC_KEYBOARD;
 
 	switch ((id >> 8)&0x0f) {
 		case 0x05:
 			return CONTROLLER_IS_N64;
 
+		case 0x02:
+			if (id == 0x0200) {
+				return CONTROLLER_IS_N64_MOUSE;
+			}
+			return CONTROLLER_IS_UNKNOWN;
+
 		case 0x09: // normal controllers
 		case 0x0b: // Never saw this one, but it is mentionned above.
 			return CONTROLLER_IS_GC;
@@ -6,6 +6,7 @@
 #define CONTROLLER_IS_GC			2
 #define CONTROLLER_IS_GC_KEYBOARD	3
 #define CONTROLLER_IS_UNKNOWN		4
+#define CONTROLLER_IS_N64_MOUSE		5
 
 
 /* Return many unknown bits, but two are about the expansion port. */
@@ -19,16 +20,32 @@
 #define N64_GET_STATUS				0x01
 #define N64_GET_STATUS_REPLY_LENGTH	32
 
-/* Read from the expansion bus. */
+/* Read from the expansion bus. Address (with CRC) follows.
+ * Returns 32 bytes of data and a data CRC byte. */
 #define N64_EXPANSION_READ			0x02
+#define N64_EXPANSION_READ_REPLY_LENGTH		264
 
-/* Write to the expansion bus. */
+/* Write to the expansion bus. Address (with CRC) and 32 bytes
+ * of data follow. Returns the data CRC. */
 #define N64_EXPANSION_WRITE			0x03
+#define N64_EXPANSION_WRITE_REPLY_LENGTH	8
 
 /* Return information about controller. */
 #define GC_GETID					0x00
 #define GC_GETID_REPLY_LENGTH		24
 
+/* Wireless (Wavebird) flags in the GC_GETID reply */
+#define GC_ID0_WIRELESS				0x80 // Byte 0: Wireless receiver
+#define GC_ID0_WIRELESS_RECEIVED	0x40 // Byte 0: A controller is talking to the receiver
+#define GC_ID1_WIRELESS_FIXED		0x10 // Byte 1: The receiver is locked to a controller
+#define GC_ID1_WIRELESS_ID_HI		0xC0 // Byte 1: Controller ID bits 9-8. (Byte 2: bits 7-0)
+
+/* Lock a wireless receiver to the controller it currently receives.
+ * 3 bytes: GC_FIX_ID, GC_ID1_WIRELESS_FIXED | ID bits 9-8, ID bits 7-0.
+ * The reply is like the GC_GETID reply. */
+#define GC_FIX_ID					0x4E
+#define GC_FIX_ID_REPLY_LENGTH		24
+
 /* 3-byte get status command. Returns axis and buttons. Also 
  * controls motor. */
 #define GC_GETSTATUS1				0x40
@@ -36,12 +53,21 @@
 #define GC_GETSTATUS3(rumbling)		((rumbling) ? 0x01 : 0x00)
 #define GC_GETSTATUS_REPLY_LENGTH	64
 
+/* Fixed bits in the first two bytes of the status reply. */
+#define GC_STATUS_ZERO_BITS			0xC0 // Byte 0 : bits 0-1 always 0
+#define GC_STATUS_ONE_BITS			0x80 // Byte 1 : bit 8 always 1
+
 /* 3-byte poll keyboard command.
  * Source: http://hitmen.c02.at/files/yagcd/yagcd/chap9.html#sec9.3.3
  * */
 #define GC_POLL_KB1					0x54
 #define GC_POLL_KB2					0x00
 #define GC_POLL_KB3					0x00
+#define GC_POLL_KB_REPLY_LENGTH		64
+
+/* The last byte of the keyboard reply is a checksum:
+ * The XOR of the 3 keycodes and of the first byte (a counter). */
+#define GC_KB_CHECKSUM(reply)		((reply)[0] ^ (reply)[4] ^ (reply)[5] ^ (reply)[6])
 
 /* Gamecube keycodes are from table 9.3.2:
  * http://hitmen.c02.at/files/yagcd/yagcd/chap9.html#sec9.3.2
@@ -158,9 +184,29 @@
 
 #define GC_KEY_ENTER			0x61
 
+/* Transmit timings */
+#define GCN64_TIMINGS_N64			0 // 3/1us
+#define GCN64_TIMINGS_GC			1 // 3.6/1.5us
+
+/* Controller families. Transmit timings are configured per family. */
+#define GCN64_FAMILY_N64			0 // N64 controllers and mouse
+#define GCN64_FAMILY_GC				1 // Gamecube controllers and keyboard
+#define GCN64_NUM_FAMILIES			2
+
 void gcn64protocol_hwinit(void);
+
+/* Use the timings configured for a family (Config.tx_timings). Also
+ * discards a change made by gcn64_toggleTimings(). */
+void gcn64_selectTimings(unsigned char family);
+unsigned char gcn64_getFamily(void);
+/* Try the other timings. Not saved. */
+void gcn64_toggleTimings(void);
+unsigned char gcn64_getTimings(void);
+unsigned char gcn64_lastTransactionUnanswered(void);
 int gcn64_detectController(void);
 int gcn64_transaction(unsigned char *data_out, int data_out_len);
+/* For long replies (N64_EXPANSION_READ), up to 300 bits */
+int gcn64_transactionBits(unsigned char *data_out, int data_out_len);
 
 unsigned char gcn64_protocol_getByte(int offset);
 void gcn64_protocol_getBytes(int offset, int n_bytes, unsigned char *dstbuf);
@@ -0,0 +1,82 @@
+/*	gc_n64_usb : Gamecube or N64 controller to USB firmware
+	Copyright (C) 2007-2016  Raphael Assenat <raph@raphnet.net>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "history.h"
+#include "gcn64_protocol.h"
+
+#ifdef WITH_HISTORY
+
+static HistoryEntry entries[HISTORY_SIZE];
+static unsigned char head; // Next entry to write
+static unsigned char count;
+static char frozen;
+
+/* Record the reply from the last transaction. Call right after polling. */
+void history_add(unsigned short timestamp, unsigned char error)
+{
+	HistoryEntry *e;
+
+	if (frozen)
+		return;
+
+	e = &entries[head];
+	e->timestamp = timestamp;
+	e->flags = error ? HISTORY_FLAG_ERROR : 0;
+	gcn64_protocol_getBytes(0, HISTORY_FRAME_SIZE, e->frame);
+
+	head = (head + 1) % HISTORY_SIZE;
+	if (count < HISTORY_SIZE)
+		count++;
+}
+
+/* Flag the most recent entry */
+void history_markSent(void)
+{
+	if (frozen || !count)
+		return;
+
+	entries[(head + HISTORY_SIZE - 1) % HISTORY_SIZE].flags |= HISTORY_FLAG_SENT;
+}
+
+/* Recording is suspended while the host reads the entries, so they
+ * do not move between two packets. */
+void history_freeze(char freeze)
+{
+	frozen = freeze;
+}
+
+/* Size, in bytes, of the recorded entries */
+unsigned short history_size(void)
+{
+	return count * sizeof(HistoryEntry);
+}
+
+/* Copy recorded entries, oldest first. offset is in bytes. */
+void history_read(unsigned char *dst, unsigned short offset, unsigned char len)
+{
+	unsigned char oldest = (head + HISTORY_SIZE - count) % HISTORY_SIZE;
+	unsigned char idx, ofs;
+
+	while (len--) {
+		idx = (oldest + offset / sizeof(HistoryEntry)) % HISTORY_SIZE;
+		ofs = offset % sizeof(HistoryEntry);
+		*dst = ((unsigned char *)&entries[idx])[ofs];
+		dst++;
+		offset++;
+	}
+}
+
+#endif // WITH_HISTORY
@@ -0,0 +1,42 @@
+#ifndef _history_h__
+#define _history_h__
+
+/* Input history
+ *
+ * When CFG_FLAG_HISTORY is set, each controller poll is recorded along
+ * with a Timer1 timestamp (5.33us per tick, wraps after 349ms). The
+ * host reads the entries, oldest first, with RQ_GET_HISTORY.
+ *
+ * Only compiled in with -DWITH_HISTORY (see the Makefiles). The entries
+ * take 88 bytes of RAM, which the 1K parts can hardly spare. Otherwise,
+ * the functions below generate no code and the history is always empty.
+ */
+#define HISTORY_SIZE		8
+#define HISTORY_FRAME_SIZE	8 // Enough for the longest (Gamecube) status reply
+
+#define HISTORY_FLAG_SENT	0x01 // A report was sent following this poll
+#define HISTORY_FLAG_ERROR	0x02 // The poll failed. The frame may be incomplete.
+
+typedef struct {
+	unsigned short timestamp;
+	unsigned char flags;
+	unsigned char frame[HISTORY_FRAME_SIZE]; // Controller reply, as received
+} HistoryEntry;
+
+#ifdef WITH_HISTORY
+void history_add(unsigned short timestamp, unsigned char error);
+void history_markSent(void);
+
+void history_freeze(char freeze);
+unsigned short history_size(void);
+void history_read(unsigned char *dst, unsigned short offset, unsigned char len);
+#else
+#define history_add(timestamp, error)
+#define history_markSent()
+#define history_freeze(freeze)
+#define history_size()					0
+#define history_read(dst, offset, len)
+#endif
+
+#endif // _history_h__
+
@@ -0,0 +1,23 @@
+/* Host build: The EEPROM is an array (host_eeprom). Writes complete
+ * immediately. */
+#ifndef _host_eeprom_h__
+#define _host_eeprom_h__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <avr/io.h>
+
+#define EEMEM
+
+extern uint8_t host_eeprom[E2END + 1];
+
+#define eeprom_is_ready()	1
+#define eeprom_busy_wait()
+
+static inline uint8_t eeprom_read_byte(const uint8_t *a) { return host_eeprom[(uintptr_t)a]; }
+static inline void eeprom_update_byte(uint8_t *a, uint8_t v) { host_eeprom[(uintptr_t)a] = v; }
+static inline void eeprom_read_block(void *d, const void *s, size_t n) { memcpy(d, host_eeprom + (uintptr_t)s, n); }
+static inline void eeprom_update_block(const void *s, void *d, size_t n) { memcpy(host_eeprom + (uintptr_t)d, s, n); }
+
+#endif // _host_eeprom_h__
@@ -0,0 +1,9 @@
+#ifndef _host_interrupt_h__
+#define _host_interrupt_h__
+
+#include <avr/io.h>
+
+#define sei()	do { SREG |= 0x80; } while(0)
+#define cli()	do { SREG &= ~0x80; } while(0)
+
+#endif // _host_interrupt_h__
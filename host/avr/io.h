@@ -0,0 +1,56 @@
+/* Host build: I/O registers are ordinary variables, except those
+ * following the simulated clock (see host.h). */
+#ifndef _host_io_h__
+#define _host_io_h__
+
+#include <stdint.h>
+#include "host.h"
+
+#define __AVR_ATmega168__	1
+#define RAMEND				0x4ff
+#define E2END				0x1ff
+
+#define _BV(b)				(1 << (b))
+#define _SFR_IO_ADDR(r)		0
+
+extern volatile uint8_t PORTB, DDRB, PINB;
+extern volatile uint8_t PORTC, DDRC, PINC;
+extern volatile uint8_t PORTD, DDRD, PIND;
+extern volatile uint8_t TCCR0A, TCCR0B, TCCR1A, TCCR1B, TCCR2A, TCCR2B, OCR2A;
+extern volatile uint8_t SREG, MCUSR, ADMUX;
+
+#define TCNT1				host_tcnt1()
+
+/* Timer flags. Writing a 1 clears a flag. */
+#define TIFR0				(*host_tifr(0))
+#define TIFR2				(*host_tifr(2))
+
+/* Conversions complete at once, with random results */
+#define ADCSRA				(*host_adcsra())
+#define ADCL				host_adc()
+#define ADCH				host_adc()
+
+/* serialno.c gathers entropy from the unused SRAM, from __heap_start
+ * to the stack. Here, that is one byte. */
+#define __heap_start		host_heap_start
+#define SP					((uintptr_t)&host_heap_start + 17)
+extern unsigned char host_heap_start;
+
+#define TOV0	0
+#define OCF2A	1
+#define WGM21	1
+#define CS10	0
+#define CS11	1
+#define CS12	2
+#define CS20	0
+#define CS21	1
+#define CS22	2
+#define WDRF	3
+#define REFS0	6
+#define ADPS0	0
+#define ADPS1	1
+#define ADPS2	2
+#define ADSC	6
+#define ADEN	7
+
+#endif // _host_io_h__
@@ -0,0 +1,14 @@
+/* Host build: Flash is ordinary memory */
+#ifndef _host_pgmspace_h__
+#define _host_pgmspace_h__
+
+#include <string.h>
+#include <stdint.h>
+
+#define PROGMEM
+#define PSTR(s)				(s)
+#define pgm_read_byte(a)	(*(const uint8_t *)(a))
+#define pgm_read_word(a)	(*(const uint16_t *)(a))
+#define memcpy_P			memcpy
+
+#endif // _host_pgmspace_h__
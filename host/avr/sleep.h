@@ -0,0 +1,10 @@
+#ifndef _host_sleep_h__
+#define _host_sleep_h__
+
+#include "host.h"
+
+#define sleep_enable()
+#define sleep_disable()
+#define sleep_cpu()		host_sleep()
+
+#endif // _host_sleep_h__
@@ -0,0 +1,13 @@
+#ifndef _host_wdt_h__
+#define _host_wdt_h__
+
+#include "host.h"
+
+#define WDTO_15MS	0
+#define WDTO_2S		7
+
+#define wdt_reset()		host_wdtReset()
+#define wdt_enable(t)	host_wdtEnable(t)
+#define wdt_disable()	host_wdtDisable()
+
+#endif // _host_wdt_h__
@@ -0,0 +1,99 @@
+/*	gc_n64_usb : Gamecube or N64 controller to USB firmware
+	Copyright (C) 2007-2016  Raphael Assenat <raph@raphnet.net>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <string.h>
+#include "config.h"
+
+/* Axis response stage: Full deflection must reach the report limits
+ * (0x00 and 0xff), the center must stay centered, and the output must
+ * not go backwards as the input increases, for all the settings. */
+
+Config g_config;
+
+static int errors;
+
+static unsigned char filter(unsigned char value, unsigned char center, unsigned char native_range)
+{
+	unsigned char built[1] = { value };
+	unsigned char sent[1] = { center };
+
+	axis_filter(built, sent, 1, center, native_range);
+
+	return built[0];
+}
+
+static void expect(const char *what, unsigned char got, unsigned char expected,
+					unsigned char center, unsigned char range)
+{
+	if (got == expected)
+		return;
+
+	if (errors++ < 20) {
+		printf("center 0x%02x range %d dz %d adz %d curve %d: %s gives 0x%02x, expected 0x%02x\n",
+				center, range, g_config.axis_deadzone[0], g_config.axis_antideadzone[0],
+				g_config.axis_curve[0], what, got, expected);
+	}
+}
+
+static void checkSettings(unsigned char center, unsigned char range)
+{
+	unsigned char prev, v;
+	int in;
+
+	// Otherwise, 0x00 and 0xff below are the full deflection
+	if (range < AXIS_MAX_RANGE) {
+		expect("full negative", filter(center - range, center, range), 0x00, center, range);
+		expect("full positive", filter(center + range, center, range), 0xff, center, range);
+	}
+	expect("0x00", filter(0x00, center, range), 0x00, center, range);
+	expect("0xff", filter(0xff, center, range), 0xff, center, range);
+	expect("center", filter(center, center, range), center, center, range);
+
+	for (in=0, prev=0; in<256; in++) {
+		v = filter(in, center, range);
+		if (v < prev) {
+			expect("monotonic", v, prev, center, range);
+		}
+		prev = v;
+	}
+}
+
+int main(void)
+{
+	static const unsigned char centers[2] = { 0x80, 0x7f }; // Gamecube, N64
+	static const unsigned char ranges[2] = { AXIS_MAX_RANGE, 80 };
+	int c, dz, adz, curve;
+
+	memset(&g_config, 0, sizeof(g_config));
+
+	for (c=0; c<2; c++) {
+		for (curve=0; curve<AXIS_NUM_CURVES; curve++) {
+			for (dz=0; dz<ranges[c]; dz++) {
+				for (adz=0; adz<=AXIS_MAX_RANGE; adz+=7) {
+					g_config.axis_deadzone[0] = dz;
+					g_config.axis_antideadzone[0] = adz;
+					g_config.axis_curve[0] = curve;
+					checkSettings(centers[c], ranges[c]);
+				}
+			}
+		}
+	}
+
+	printf("axis_check: %d error(s)\n", errors);
+
+	return errors ? 1 : 0;
+}
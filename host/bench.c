@@ -0,0 +1,225 @@
+/* Host benchmark of the input path.
+ *
+ * Replays controller replies (frames.txt) through the firmware code and
+ * prints the average time per call as CSV, to compare builds:
+ *
+ *   set,decoder,function,calls,ns_per_call
+ *
+ * transaction and update include the simulated data line (gcn64_bus.c).
+ * Its cost does not depend on the firmware, so differences between two
+ * builds remain meaningful.
+ *
+ * These are host times, not AVR cycles. For cycles on the real device,
+ * build the firmware with -DWITH_PROFILING and read RQ_GET_PROFILE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "host.h"
+#include "gamepad.h"
+#include "gamecube.h"
+#include "n64.h"
+#include "gc_kb.h"
+#include "n64_mouse.h"
+#include "gcn64_protocol.h"
+#include "config.h"
+
+#define MAX_FRAMES	256
+#define MAX_LEN		8
+
+typedef struct {
+	const char *name;
+	unsigned char id[3]; // Reply to GC_GETID / N64_GET_CAPABILITIES
+	unsigned char cmd[3]; // Status command
+	unsigned char cmd_len;
+	Gamepad *(*getGamepad)(void);
+
+	unsigned char frames[MAX_FRAMES][MAX_LEN];
+	int len; // bytes per frame
+	int count;
+} FrameSet;
+
+static FrameSet sets[] = {
+	{ "gc",		{ 0x09, 0x00, 0x00 }, { GC_GETSTATUS1, GC_GETSTATUS2, 0 }, 3, gamecubeGetGamepad },
+	{ "n64",	{ 0x05, 0x00, 0x00 }, { N64_GET_STATUS }, 1, n64GetGamepad },
+	{ "kb",		{ 0x08, 0x20, 0x00 }, { GC_POLL_KB1, GC_POLL_KB2, GC_POLL_KB3 }, 3, gc_kb_getGamepad },
+	{ "mouse",	{ 0x02, 0x00, 0x00 }, { N64_GET_STATUS }, 1, n64_mouse_getGamepad },
+};
+#define NUM_SETS	(sizeof(sets) / sizeof(sets[0]))
+
+static FrameSet *cur_set;
+static int cur_frame;
+
+/* From main.c */
+Gamepad g_gamepad;
+
+/* Not called by the paths measured here */
+void usbPoll(void)
+{
+}
+
+static int controller(const unsigned char *cmd, int cmd_len, unsigned char *reply)
+{
+	if (cmd[0] == GC_GETID) {
+		memcpy(reply, cur_set->id, 3);
+		return 24;
+	}
+
+	memcpy(reply, cur_set->frames[cur_frame], cur_set->len);
+	return cur_set->len * 8;
+}
+
+static int loadFrames(const char *filename)
+{
+	FILE *fptr;
+	char line[256], name[16];
+	int i, n, pos, val;
+
+	fptr = fopen(filename, "r");
+	if (!fptr) {
+		perror(filename);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), fptr)) {
+		if (sscanf(line, "%15s%n", name, &pos) != 1 || name[0] == '#')
+			continue;
+
+		for (i=0; i<NUM_SETS; i++) {
+			if (!strcmp(name, sets[i].name))
+				break;
+		}
+		if (i == NUM_SETS || sets[i].count == MAX_FRAMES) {
+			fprintf(stderr, "%s: ignored: %s", filename, line);
+			continue;
+		}
+
+		for (n=0; n<MAX_LEN; n++) {
+			int used;
+			if (sscanf(line + pos, "%x%n", &val, &used) != 1)
+				break;
+			sets[i].frames[sets[i].count][n] = val;
+			pos += used;
+		}
+		if (sets[i].count && n != sets[i].len) {
+			fprintf(stderr, "%s: wrong length: %s", filename, line);
+			continue;
+		}
+		sets[i].len = n;
+		sets[i].count++;
+	}
+
+	fclose(fptr);
+	return 0;
+}
+
+static double nowNs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void print(const char *decoder, const char *function, long calls, double ns)
+{
+	printf("%s,%s,%s,%ld,%.1f\n", cur_set->name, decoder, function, calls, ns / calls);
+}
+
+static void benchSet(const char *decoder, int rounds)
+{
+	Gamepad *pad;
+	unsigned char cmd[3], buf[16];
+	long calls = (long)rounds * cur_set->count;
+	double t;
+	int r;
+
+	// The simulated line must give the frames back unchanged
+	for (cur_frame=0; cur_frame<cur_set->count; cur_frame++) {
+		memcpy(cmd, cur_set->cmd, cur_set->cmd_len);
+		if (gcn64_transaction(cmd, cur_set->cmd_len) != cur_set->len * 8) {
+			fprintf(stderr, "%s frame %d: wrong length\n", cur_set->name, cur_frame);
+			exit(1);
+		}
+		gcn64_protocol_getBytes(0, cur_set->len, buf);
+		if (memcmp(buf, cur_set->frames[cur_frame], cur_set->len)) {
+			fprintf(stderr, "%s frame %d: decoded wrong\n", cur_set->name, cur_frame);
+			exit(1);
+		}
+	}
+
+	pad = cur_set->getGamepad();
+	cur_frame = 0;
+	pad->init();
+
+	t = nowNs();
+	for (r=0; r<rounds; r++) {
+		for (cur_frame=0; cur_frame<cur_set->count; cur_frame++) {
+			memcpy(cmd, cur_set->cmd, cur_set->cmd_len);
+			gcn64_transaction(cmd, cur_set->cmd_len);
+		}
+	}
+	print(decoder, "transaction", calls, nowNs() - t);
+
+	t = nowNs();
+	for (r=0; r<rounds; r++) {
+		for (cur_frame=0; cur_frame<cur_set->count; cur_frame++) {
+			gcn64_protocol_getBytes(0, cur_set->len, buf);
+		}
+	}
+	print(decoder, "getBytes", calls, nowNs() - t);
+
+	t = nowNs();
+	for (r=0; r<rounds; r++) {
+		for (cur_frame=0; cur_frame<cur_set->count; cur_frame++) {
+			pad->update();
+		}
+	}
+	print(decoder, "update", calls, nowNs() - t);
+
+	t = nowNs();
+	for (r=0; r<rounds; r++) {
+		for (cur_frame=0; cur_frame<cur_set->count; cur_frame++) {
+			pad->changed(1);
+			pad->buildReport(buf, 1);
+		}
+	}
+	print(decoder, "buildReport", calls, nowNs() - t);
+}
+
+int main(int argc, char **argv)
+{
+	const char *filename = "frames.txt";
+	int rounds = 20000;
+	int i;
+
+	if (argc > 1)
+		filename = argv[1];
+	if (argc > 2)
+		rounds = atoi(argv[2]);
+	if (argc > 3 || rounds < 1) {
+		fprintf(stderr, "Usage: %s [frames file] [rounds]\n", argv[0]);
+		return 1;
+	}
+
+	if (loadFrames(filename))
+		return 1;
+
+	config_init();
+	host_controller = controller;
+
+	printf("set,decoder,function,calls,ns_per_call\n");
+	for (i=0; i<NUM_SETS; i++) {
+		cur_set = &sets[i];
+		if (!cur_set->count)
+			continue;
+
+		g_config.flags &= ~CFG_FLAG_ADAPTIVE_DECODE;
+		benchSet("standard", rounds);
+		g_config.flags |= CFG_FLAG_ADAPTIVE_DECODE;
+		benchSet("adaptive", rounds);
+	}
+
+	return 0;
+}
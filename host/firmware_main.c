@@ -0,0 +1,9 @@
+/* Host builds: main.c, with main() renamed so a harness can call it */
+#define main firmware_main
+
+/* usbRequest_t is larger than the 8 byte setup packet here, as unsigned
+ * is 32 bits wide (see usbdrv.h). Callers of usbFunctionSetup() pass a
+ * whole usbRequest_t. */
+#pragma GCC diagnostic ignored "-Warray-bounds"
+
+#include "../main.c"
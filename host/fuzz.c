@@ -0,0 +1,343 @@
+/* Fuzz target for the control transfer entry points and the controller
+ * reply decoders.
+ *
+ * The input is a sequence of operations:
+ *
+ *   0: Control transfer. 8 setup bytes, then the OUT data stage (if any)
+ *      from the input. Goes through usbFunctionSetup() (or
+ *      usbFunctionDescriptor()), then usbFunctionRead()/usbFunctionWrite()
+ *      in 8 byte packets, like V-USB would.
+ *   1: Queue a controller reply. Length in bits (2 bytes, up to
+ *      HOST_MAX_REPLY * 8), then the reply bytes. Without queued replies,
+ *      the controller does not answer.
+ *   2: Poll the controller like the main loop does (decoders, remapping,
+ *      axis processing, reports).
+ *   3: Detect the controller (tryDetectController()).
+ *   4: Run the deferred tasks (vendor requests, EEPROM writes).
+ *   5: Decoder settings. 1 byte: bit 0 CFG_FLAG_ADAPTIVE_DECODE, bits 1-2
+ *      level timing jitter.
+ *
+ * Built with libFuzzer (make fuzz, needs clang), this file only provides
+ * LLVMFuzzerTestOneInput(). Otherwise (make asan), main() runs the files
+ * given as arguments, or random inputs from a fixed seed.
+ *
+ * Bad accesses are found by the sanitizers. The harness itself checks what
+ * V-USB relies on: usbFunctionRead() never returns more than requested.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <setjmp.h>
+#include <avr/eeprom.h>
+#include "host.h"
+#include "usbdrv_sim.h"
+#include "firmware_main.c"
+#undef main
+
+#define MAX_QUEUE	16
+
+typedef struct {
+	const uint8_t *data;
+	size_t size;
+} Input;
+
+static unsigned char queue[MAX_QUEUE][HOST_MAX_REPLY];
+static int queue_bits[MAX_QUEUE];
+static int queue_head, queue_len;
+
+static int getByte(Input *in)
+{
+	if (!in->size)
+		return -1;
+	in->size--;
+	return *in->data++;
+}
+
+static int controller(const unsigned char *cmd, int cmd_len, unsigned char *reply)
+{
+	int bits;
+
+	if (!queue_len)
+		return 0;
+
+	bits = queue_bits[queue_head];
+	memcpy(reply, queue[queue_head], HOST_MAX_REPLY);
+	queue_head = (queue_head + 1) % MAX_QUEUE;
+	queue_len--;
+
+	return bits;
+}
+
+static void queueReply(Input *in)
+{
+	int slot, bits, hi, lo, i;
+
+	hi = getByte(in);
+	lo = getByte(in);
+	if (lo < 0 || queue_len == MAX_QUEUE)
+		return;
+	bits = ((hi << 8) | lo) % (HOST_MAX_REPLY * 8 + 1);
+
+	slot = (queue_head + queue_len) % MAX_QUEUE;
+	memset(queue[slot], 0, HOST_MAX_REPLY);
+	for (i=0; i<(bits+7)/8; i++) {
+		int b = getByte(in);
+		if (b < 0)
+			break;
+		queue[slot][i] = b;
+	}
+	queue_bits[slot] = bits;
+	queue_len++;
+}
+
+/* Descriptors V-USB asks usbFunctionDescriptor() for (see usbconfig.h) */
+static int isDynamicDescriptor(usbRequest_t *rq)
+{
+	switch (rq->wValue.bytes[1])
+	{
+		case USBDESCR_DEVICE:
+		case USBDESCR_CONFIG:
+		case USBDESCR_HID_REPORT:
+			return 1;
+		case USBDESCR_STRING:
+			return rq->wValue.bytes[0] == 3; // serial number
+	}
+	return 0;
+}
+
+static void controlTransfer(Input *in)
+{
+	uint8_t setup[8];
+	usbRequest_t rq; // Larger than 8 bytes here, see firmware_main.c
+	usbMsgLen_t len;
+	uchar buf[8];
+	unsigned remaining;
+	int i, b;
+
+	for (i=0; i<8; i++) {
+		b = getByte(in);
+		if (b < 0)
+			return;
+		setup[i] = b;
+	}
+
+	memset(&rq, 0, sizeof(rq));
+	rq.bmRequestType = setup[0];
+	rq.bRequest = setup[1];
+	rq.wValue.word = setup[2] | (setup[3] << 8);
+	rq.wIndex.word = setup[4] | (setup[5] << 8);
+	rq.wLength.word = setup[6] | (setup[7] << 8);
+
+	if ((rq.bmRequestType & USBRQ_TYPE_MASK) == USBRQ_TYPE_STANDARD) {
+		if (rq.bRequest != USBRQ_GET_DESCRIPTOR || !isDynamicDescriptor(&rq))
+			return; // Handled by the driver
+		len = usbFunctionDescriptor(&rq);
+	} else {
+		len = usbFunctionSetup((uchar *)&rq);
+	}
+
+	remaining = rq.wLength.word;
+
+	if (len != USB_NO_MSG) {
+		// The driver sends from usbMsgPtr
+		volatile uchar sink;
+		const uchar *p = (const uchar *)usbMsgPtr;
+
+		if (!(rq.bmRequestType & USBRQ_DIR_DEVICE_TO_HOST))
+			return;
+		if (len > remaining)
+			len = remaining;
+		for (i=0; i<len; i++)
+			sink = p[i];
+		(void)sink;
+		return;
+	}
+
+	if (rq.bmRequestType & USBRQ_DIR_DEVICE_TO_HOST) {
+		while (remaining) {
+			uchar n = remaining < 8 ? remaining : 8;
+			uchar got = usbFunctionRead(buf, n);
+
+			if (got > n) {
+				fprintf(stderr, "usbFunctionRead() returned %d for %d bytes\n", got, n);
+				abort();
+			}
+			remaining -= got;
+			if (got < n)
+				break;
+		}
+	} else {
+		while (remaining) {
+			uchar n = remaining < 8 ? remaining : 8;
+
+			for (i=0; i<n; i++) {
+				b = getByte(in);
+				if (b < 0)
+					return; // Transfer never completes
+				buf[i] = b;
+			}
+			// Non-zero: done (1) or stall (0xff)
+			if (usbFunctionWrite(buf, n))
+				break;
+			remaining -= n;
+		}
+	}
+}
+
+static void pollController(void)
+{
+	if (!curGamepad)
+		return;
+
+	// Let the poll timer expire
+	host_advance((g_config.poll_period + 1) * 1024ULL * 1000000000ULL / F_CPU);
+	controller_present_doTasks(0);
+}
+
+static void doTasks(void)
+{
+	config_doTasks();
+	serialno_doTasks();
+	remap_doTasks();
+	vendor_doTasks();
+}
+
+static void decoderSettings(Input *in)
+{
+	int b = getByte(in);
+
+	if (b < 0)
+		return;
+
+	if (b & 1)
+		g_config.flags |= CFG_FLAG_ADAPTIVE_DECODE;
+	else
+		g_config.flags &= ~CFG_FLAG_ADAPTIVE_DECODE;
+	host_jitter = (b >> 1) & 3;
+}
+
+/* Initialization: firmware_main() until USB is up */
+static jmp_buf started;
+
+static void usbPolled(void)
+{
+	if (host_usbRunning)
+		longjmp(started, 1);
+}
+
+static void init(void)
+{
+	memset(host_eeprom, 0xff, sizeof(host_eeprom));
+	host_usbPolled = usbPolled;
+	if (!setjmp(started)) {
+		firmware_main();
+	}
+	host_usbPolled = NULL;
+	host_controller = controller;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	static char initialized;
+	Input in = { data, size };
+	int op;
+
+	if (!initialized) {
+		init();
+		initialized = 1;
+	}
+
+	queue_len = 0;
+
+	while ((op = getByte(&in)) >= 0) {
+		switch (op % 6)
+		{
+			case 0: controlTransfer(&in); break;
+			case 1: queueReply(&in); break;
+			case 2: pollController(); break;
+			case 3: curGamepad = tryDetectController(); break;
+			case 4: doTasks(); break;
+			case 5: decoderSettings(&in); break;
+		}
+	}
+
+	return 0;
+}
+
+#ifndef WITH_LIBFUZZER
+static int runFile(const char *filename)
+{
+	static uint8_t buf[65536];
+	FILE *fptr;
+	size_t size;
+
+	fptr = fopen(filename, "rb");
+	if (!fptr) {
+		perror(filename);
+		return 1;
+	}
+	size = fread(buf, 1, sizeof(buf), fptr);
+	fclose(fptr);
+
+	LLVMFuzzerTestOneInput(buf, size);
+	return 0;
+}
+
+/* Random inputs, biased toward meaningful operations */
+static void runRandom(int count)
+{
+	static const uint8_t ids[][3] = {
+		{ 0x05, 0x00, 0x01 }, // N64 controller
+		{ 0x09, 0x00, 0x00 }, // Gamecube controller
+		{ 0x08, 0x20, 0x00 }, // Gamecube keyboard
+		{ 0x02, 0x00, 0x00 }, // N64 mouse
+	};
+	uint8_t buf[512];
+	int i, n, len;
+
+	srand(1);
+	for (n=0; n<count; n++) {
+		len = rand() % sizeof(buf);
+		for (i=0; i<len; i++) {
+			buf[i] = rand();
+			// Mostly vendor requests, with the right protocol version
+			if (i + 8 < len && buf[i] % 6 == 0 && rand() % 2) {
+				buf[++i] = USBRQ_TYPE_VENDOR | (rand() % 2 ? USBRQ_DIR_DEVICE_TO_HOST : 0);
+				buf[++i] = rand() % 0x18;
+				buf[++i] = rand() % 4 ? 0 : rand();
+				buf[++i] = rand() % 4 ? 0 : rand();
+				buf[++i] = VENDOR_PROTOCOL_VERSION;
+				buf[++i] = 0;
+				buf[++i] = rand() % 4 ? rand() % 64 : rand();
+				buf[++i] = rand() % 4 ? 0 : rand();
+			}
+			// Controller IDs, so that detection succeeds
+			else if (i + 5 < len && buf[i] % 6 == 1 && rand() % 2) {
+				memcpy(buf + i + 3, ids[rand() % 4], 3);
+				buf[++i] = 0;
+				buf[++i] = 24;
+				i += 3;
+			}
+		}
+		LLVMFuzzerTestOneInput(buf, len);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	int i, res = 0;
+
+	if (argc < 2) {
+		runRandom(20000);
+		printf("fuzz: 20000 random inputs done\n");
+		return 0;
+	}
+
+	for (i=1; i<argc; i++) {
+		res |= runFile(argv[i]);
+	}
+
+	return res;
+}
+#endif
@@ -0,0 +1,128 @@
+/* Host builds: gcn64_protocol.c with a simulated data line.
+ *
+ * Commands go to host_controller. Its reply is turned into the level
+ * durations the receiver would have measured, which the firmware code
+ * then decodes as usual.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "host.h"
+
+static unsigned char gcn64_receive(void);
+static int gcn64_receiveBits(void);
+static void gcn64_sendBytes(unsigned char *data, unsigned char n_bytes);
+
+#include "../gcn64_protocol.c"
+
+/* Durations on the line, in ns. A short low level is a 1. */
+#define BIT_SHORT		1000
+#define BIT_LONG		3000
+#define BIT_PERIOD		(BIT_SHORT + BIT_LONG)
+
+/* The receiver loops take 5 cycles and start at TIMING_OFFSET. A level
+ * still going on at 128 is a timeout. */
+#define LOOP_NS			(5 * 1000000000ULL / F_CPU)
+#define RX_TIMEOUT_NS	((128 - TIMING_OFFSET) * LOOP_NS)
+#define RX_NO_REPLY_NS	(256 * LOOP_NS)
+
+HostController host_controller;
+unsigned char host_jitter;
+
+static unsigned char cmd[GCN64_BUF_SIZE / 8];
+static int cmd_len;
+
+static unsigned char levelCount(unsigned int ns)
+{
+	int c = TIMING_OFFSET + ns / LOOP_NS;
+
+	if (host_jitter)
+		c += rand() % (host_jitter * 2 + 1) - host_jitter;
+	if (c <= TIMING_OFFSET)
+		c = TIMING_OFFSET + 1;
+	if (c > 127)
+		c = 127;
+	return c;
+}
+
+/* Calls the controller. Returns the reply length in bits, 0 if none. */
+static int reply(unsigned char *buf)
+{
+	int bits;
+
+	if (!cmd_len || !host_controller)
+		return 0;
+
+	bits = host_controller(cmd, cmd_len, buf);
+	cmd_len = 0;
+	if (bits < 0)
+		bits = 0;
+	if (bits > HOST_MAX_REPLY * 8)
+		bits = HOST_MAX_REPLY * 8;
+	return bits;
+}
+
+static void gcn64_sendBytes(unsigned char *data, unsigned char n_bytes)
+{
+	cmd_len = 0;
+	if (n_bytes == 0)
+		return;
+
+	// Same limit as the firmware
+	if (!bitsToWorkbufBytes(data, n_bytes, 0))
+		return;
+
+	memcpy(cmd, data, n_bytes);
+	cmd_len = n_bytes;
+	host_advance((n_bytes * 8 + 1) * BIT_PERIOD);
+}
+
+static unsigned char gcn64_receive(void)
+{
+	unsigned char buf[HOST_MAX_REPLY];
+	int bits, i, levels = 0;
+
+	bits = reply(buf);
+	if (!bits) {
+		host_advance(RX_NO_REPLY_NS);
+		return 0;
+	}
+	host_advance(bits * BIT_PERIOD + BIT_SHORT + RX_TIMEOUT_NS);
+
+	for (i=0; i<bits; i++) {
+		char one = buf[i/8] & (0x80 >> (i%8));
+
+		// The 8 bit level counter wraps to 0 (see gcn64_receive)
+		if (levels + 2 > 255)
+			return 0;
+		gcn64_workbuf[levels++] = levelCount(one ? BIT_SHORT : BIT_LONG);
+		gcn64_workbuf[levels++] = levelCount(one ? BIT_LONG : BIT_SHORT);
+	}
+	if (levels + 1 > 255)
+		return 0;
+	gcn64_workbuf[levels++] = levelCount(BIT_SHORT); // stop bit
+
+	return levels;
+}
+
+static int gcn64_receiveBits(void)
+{
+	unsigned char buf[HOST_MAX_REPLY];
+	int bits, i;
+
+	bits = reply(buf);
+	if (!bits) {
+		host_advance(RX_NO_REPLY_NS);
+		return 0;
+	}
+	host_advance(bits * BIT_PERIOD + BIT_SHORT + RX_TIMEOUT_NS);
+
+	for (i=0; i<bits && i<GCN64_BUF_SIZE; i++) {
+		char one = buf[i/8] & (0x80 >> (i%8));
+		unsigned char lo = levelCount(one ? BIT_SHORT : BIT_LONG);
+		unsigned char hi = levelCount(one ? BIT_LONG : BIT_SHORT);
+
+		gcn64_workbuf[i] = lo < hi ? 0xff : 0x00;
+	}
+
+	return i;
+}
@@ -0,0 +1,105 @@
+/* Host builds: Registers, EEPROM and the simulated clock */
+#include <stdint.h>
+#include <stdlib.h>
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <avr/wdt.h>
+#include "host.h"
+
+volatile uint8_t PORTB, DDRB, PINB;
+volatile uint8_t PORTC, DDRC, PINC;
+volatile uint8_t PORTD, DDRD, PIND;
+volatile uint8_t TCCR0A, TCCR0B, TCCR1A, TCCR1B, TCCR2A, TCCR2B, OCR2A;
+volatile uint8_t SREG, MCUSR, ADMUX;
+unsigned char host_heap_start;
+
+uint8_t host_eeprom[E2END + 1];
+
+unsigned long long host_now;
+
+void (*host_watchdog)(void);
+static unsigned long long wdt_timeout;
+static unsigned long long wdt_deadline;
+
+#define NS_PER_CYCLES(c)	((c) * 1000000000ULL / F_CPU)
+
+void host_advance(unsigned long ns)
+{
+	host_now += ns;
+
+	if (wdt_timeout && host_now > wdt_deadline) {
+		wdt_timeout = 0;
+		if (host_watchdog)
+			host_watchdog();
+	}
+}
+
+unsigned short host_tcnt1(void)
+{
+	return host_now * (F_CPU / 1000000) / 64000;
+}
+
+/* Timer0 overflow and Timer2 compare match */
+static unsigned long long timer_next[3];
+static unsigned char tifr_flags[3];
+static volatile unsigned char tifr_reg[3] = { HOST_TIFR_UNCHANGED, 0, HOST_TIFR_UNCHANGED };
+
+static unsigned long long timerPeriod(int timer)
+{
+	if (timer == 2)
+		return NS_PER_CYCLES((OCR2A + 1) * 1024ULL);
+	return NS_PER_CYCLES(256 * 1024ULL);
+}
+
+volatile unsigned char *host_tifr(int timer)
+{
+	unsigned char flag = timer == 2 ? (1<<OCF2A) : (1<<TOV0);
+
+	if (!(tifr_reg[timer] & HOST_TIFR_UNCHANGED))
+		tifr_flags[timer] &= ~tifr_reg[timer];
+
+	if (!timer_next[timer])
+		timer_next[timer] = timerPeriod(timer);
+	if (host_now >= timer_next[timer]) {
+		tifr_flags[timer] |= flag;
+		while (timer_next[timer] <= host_now)
+			timer_next[timer] += timerPeriod(timer);
+	}
+
+	tifr_reg[timer] = tifr_flags[timer] | HOST_TIFR_UNCHANGED;
+	return &tifr_reg[timer];
+}
+
+static volatile unsigned char adcsra;
+
+volatile unsigned char *host_adcsra(void)
+{
+	adcsra &= ~(1<<ADSC);
+	return &adcsra;
+}
+
+unsigned char host_adc(void)
+{
+	return rand();
+}
+
+void host_wdtReset(void)
+{
+	wdt_deadline = host_now + wdt_timeout;
+}
+
+void host_wdtEnable(int timeout)
+{
+	wdt_timeout = 16000000ULL << timeout;
+	host_wdtReset();
+}
+
+void host_wdtDisable(void)
+{
+	wdt_timeout = 0;
+}
+
+void host_sleep(void)
+{
+	host_advance(1000000 - host_now % 1000000);
+}
@@ -0,0 +1,50 @@
+/* Host builds: Simulated clock and controller.
+ *
+ * Time only advances through the firmware delays, the simulated data
+ * line and the hooks below. Everything else takes no time.
+ */
+#ifndef _host_h__
+#define _host_h__
+
+/* Nanoseconds since start */
+extern unsigned long long host_now;
+
+void host_advance(unsigned long ns);
+
+/* Timer1 (clk/64), derived from host_now */
+unsigned short host_tcnt1(void);
+
+/* TIFR0 and TIFR2: Timer0 overflow (clk/1024) and Timer2 compare match
+ * (clk/1024, period OCR2A + 1). The returned register reads as the
+ * current flags, plus HOST_TIFR_UNCHANGED. A value written by the
+ * firmware lacks that bit. The flags written as 1 are then cleared
+ * at the next call. */
+#define HOST_TIFR_UNCHANGED	0x80
+volatile unsigned char *host_tifr(int timer);
+
+volatile unsigned char *host_adcsra(void);
+unsigned char host_adc(void);
+
+void host_wdtReset(void);
+void host_wdtEnable(int timeout);
+void host_wdtDisable(void);
+
+/* Called when the watchdog fires. If it returns, the watchdog
+ * is disabled. */
+extern void (*host_watchdog)(void);
+
+/* sleep_cpu(): Until the next USB interrupt (start of frame, every 1ms) */
+void host_sleep(void);
+
+/* The simulated controller is called with each command sent on the data
+ * line. It writes its reply to reply (HOST_MAX_REPLY bytes available) and
+ * returns the reply length in bits. 0 for no reply. */
+#define HOST_MAX_REPLY	40
+typedef int (*HostController)(const unsigned char *cmd, int cmd_len, unsigned char *reply);
+extern HostController host_controller;
+
+/* Random error added to each level duration the receiver measures, in
+ * loop iterations (5 cycles). 0 for exact timings. */
+extern unsigned char host_jitter;
+
+#endif // _host_h__
@@ -0,0 +1,496 @@
+/* Host simulation of the controller link and detection (main.c).
+ *
+ * The firmware main loop runs on the simulated clock (host.h), against
+ * scripted controllers which can be plugged, unplugged, or answer badly.
+ * All through each scenario, these must hold:
+ *
+ * - usbPoll() is called at least every 50ms once USB is up
+ * - the watchdog never fires
+ *
+ * Each scenario then checks its own expectations (controller lost and
+ * found again in time, released keys reported, ...).
+ *
+ * The firmware state is in static variables, so each scenario runs in
+ * its own process. Runs are deterministic: time is simulated and the
+ * random numbers come from a fixed seed.
+ *
+ *   sim			Run all scenarios
+ *   sim name		Run one scenario
+ *   sim -v name	Also print the state changes
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <setjmp.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <avr/eeprom.h>
+#include "host.h"
+#include "usbdrv_sim.h"
+#include "gcn64_protocol.h"
+#include "stats.h"
+
+int firmware_main(void);
+
+#define MS				1000000ULL
+#define MAX_USBPOLL_GAP	(50 * MS)
+
+/* Simulated devices */
+#define DEV_NONE		0
+#define DEV_GC			1
+#define DEV_N64			2
+#define DEV_KB			3 // A key held
+#define DEV_MOUSE		4 // A button held
+#define DEV_NOISE		5 // Random replies
+#define NUM_DEVS		6
+
+static const char *dev_names[NUM_DEVS] = { "none", "gc", "n64", "kb", "mouse", "noise" };
+
+typedef struct {
+	unsigned long ms; // Start time
+	unsigned char dev;
+	unsigned char drop_pct; // Replies lost
+	unsigned char corrupt_pct; // Replies with a bit flipped or missing bits
+} Step;
+
+#define MAX_STEPS	32
+
+typedef struct {
+	const char *name;
+	unsigned long duration_ms;
+	Step steps[MAX_STEPS]; // Ends at the first step with ms == 0, after the first
+	void (*check)(void);
+	unsigned int seed;
+} Scenario;
+
+/* What happened during each step */
+typedef struct {
+	unsigned long long first_poll; // First status command answered (0: none)
+	unsigned long long first_report; // First report read by the host
+	unsigned long long first_release; // First report with nothing pressed
+	unsigned long long lost; // The firmware lost the controller
+	unsigned int reports;
+} Observed;
+
+static const Scenario *scenario;
+static int num_steps;
+static int cur_step;
+static Observed observed[MAX_STEPS];
+static unsigned long long end_time;
+static unsigned long long last_usbpoll;
+static unsigned long long max_usbpoll_gap;
+static unsigned short last_disconnects;
+static int failures;
+static int verbose;
+static jmp_buf done;
+
+static void fail(const char *fmt, ...)
+{
+	va_list ap;
+
+	printf("%s: %.1fms: ", scenario->name, host_now / 1e6);
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+	printf("\n");
+	failures++;
+}
+
+static void trace(const char *fmt, ...)
+{
+	va_list ap;
+
+	if (!verbose)
+		return;
+
+	printf("%10.3fms ", host_now / 1e6);
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+	printf("\n");
+}
+
+static const Step *step(void)
+{
+	return &scenario->steps[cur_step];
+}
+
+static void nextStep(void)
+{
+	while (cur_step + 1 < num_steps &&
+			host_now >= scenario->steps[cur_step + 1].ms * MS) {
+		cur_step++;
+		trace("step %d: %s", cur_step, dev_names[step()->dev]);
+	}
+}
+
+static int deviceId(unsigned char dev, unsigned char *reply)
+{
+	static const unsigned char ids[NUM_DEVS][3] = {
+		[DEV_GC] = { 0x09, 0x00, 0x00 },
+		[DEV_N64] = { 0x05, 0x00, 0x00 },
+		[DEV_KB] = { 0x08, 0x20, 0x00 },
+		[DEV_MOUSE] = { 0x02, 0x00, 0x00 },
+	};
+
+	memcpy(reply, ids[dev], 3);
+	return 24;
+}
+
+/* The status reply, or 0 when the command is not for this device */
+static int deviceStatus(unsigned char dev, const unsigned char *cmd, int cmd_len, unsigned char *reply)
+{
+	static const unsigned char gc_idle[8] = { 0x00, 0x80, 0x80, 0x80, 0x80, 0x80, 0x00, 0x00 };
+	static const unsigned char kb_h[8] = { 0x00, 0x00, 0x00, 0x00, GC_KEY_H, 0x00, 0x00, GC_KEY_H };
+
+	switch (dev)
+	{
+		case DEV_GC:
+			if (cmd_len != 3 || cmd[0] != GC_GETSTATUS1)
+				return 0;
+			memcpy(reply, gc_idle, 8);
+			return GC_GETSTATUS_REPLY_LENGTH;
+
+		case DEV_KB:
+			if (cmd_len != 3 || cmd[0] != GC_POLL_KB1)
+				return 0;
+			memcpy(reply, kb_h, 8);
+			return GC_POLL_KB_REPLY_LENGTH;
+
+		case DEV_N64:
+		case DEV_MOUSE:
+			if (cmd_len != 1 || cmd[0] != N64_GET_STATUS)
+				return 0;
+			memset(reply, 0, 4);
+			if (dev == DEV_MOUSE)
+				reply[0] = 0x80; // A: Left button
+			return N64_GET_STATUS_REPLY_LENGTH;
+	}
+
+	return 0;
+}
+
+static int controller(const unsigned char *cmd, int cmd_len, unsigned char *reply)
+{
+	const Step *s;
+	int bits, i;
+
+	nextStep();
+	s = step();
+
+	if (s->dev == DEV_NONE)
+		return 0;
+	if (rand() % 100 < s->drop_pct)
+		return 0;
+
+	if (s->dev == DEV_NOISE) {
+		bits = 1 + rand() % 80;
+		for (i=0; i<(bits+7)/8; i++)
+			reply[i] = rand();
+		return bits;
+	}
+
+	if (cmd[0] == GC_GETID) {
+		bits = deviceId(s->dev, reply);
+	} else {
+		bits = deviceStatus(s->dev, cmd, cmd_len, reply);
+		if (!bits)
+			return 0;
+		if (!observed[cur_step].first_poll)
+			observed[cur_step].first_poll = host_now;
+	}
+
+	if (rand() % 100 < s->corrupt_pct) {
+		if (rand() % 2) {
+			i = rand() % bits;
+			reply[i/8] ^= 0x80 >> (i%8);
+		} else {
+			bits -= 1 + rand() % 8;
+		}
+	}
+
+	return bits;
+}
+
+static void usbReport(const unsigned char *data, unsigned char len)
+{
+	Observed *o;
+	int i;
+
+	nextStep();
+	o = &observed[cur_step];
+	o->reports++;
+	if (!o->first_report)
+		o->first_report = host_now;
+
+	// Keyboard and mouse reports only (no report ID)
+	if (len != 8 && len != 3)
+		return;
+	for (i=0; i<len; i++) {
+		if (data[i])
+			return;
+	}
+	if (!o->first_release) {
+		o->first_release = host_now;
+		trace("released (%d bytes)", len);
+	}
+}
+
+static void usbPolled(void)
+{
+	unsigned long long gap = host_now - last_usbpoll;
+
+	nextStep();
+
+	if (host_usbRunning && last_usbpoll && gap > max_usbpoll_gap) {
+		max_usbpoll_gap = gap;
+		if (gap > MAX_USBPOLL_GAP)
+			fail("usbPoll() not called for %.1fms", gap / 1e6);
+	}
+	last_usbpoll = host_now;
+
+	if (g_stats.disconnects != last_disconnects) {
+		last_disconnects = g_stats.disconnects;
+		if (!observed[cur_step].lost)
+			observed[cur_step].lost = host_now;
+		trace("controller lost");
+	}
+
+	if (host_now >= end_time)
+		longjmp(done, 1);
+}
+
+static void watchdog(void)
+{
+	fail("watchdog reset");
+	longjmp(done, 1);
+}
+
+/*** Checks ***/
+
+/* Time from the start of step i, in ms */
+static double sinceStep(int i, unsigned long long t)
+{
+	return (t - scenario->steps[i].ms * MS) / 1e6;
+}
+
+static void expectFound(int i, double max_ms)
+{
+	if (!observed[i].first_poll) {
+		fail("step %d: %s never polled", i, dev_names[scenario->steps[i].dev]);
+	} else if (sinceStep(i, observed[i].first_poll) > max_ms) {
+		fail("step %d: %s polled after %.1fms (max. %.0f)", i,
+			dev_names[scenario->steps[i].dev], sinceStep(i, observed[i].first_poll), max_ms);
+	}
+}
+
+static void expectLost(int i, double max_ms)
+{
+	if (!observed[i].lost) {
+		fail("step %d: controller not lost", i);
+	} else if (sinceStep(i, observed[i].lost) > max_ms) {
+		fail("step %d: controller lost after %.1fms (max. %.0f)", i,
+			sinceStep(i, observed[i].lost), max_ms);
+	}
+}
+
+static void expectReleased(int i, double max_ms)
+{
+	if (!observed[i].first_release) {
+		fail("step %d: no released report", i);
+	} else if (sinceStep(i, observed[i].first_release) > max_ms) {
+		fail("step %d: released after %.1fms (max. %.0f)", i,
+			sinceStep(i, observed[i].first_release), max_ms);
+	}
+}
+
+static void checkAbsent(void)
+{
+	/* Detection backs off to DETECT_BACKOFF_MAX poll periods (~270ms),
+	 * but goes on. */
+	double seconds = scenario->duration_ms / 1000.0;
+
+	if (g_stats.detect_attempts > seconds * 1000 / 250 + 10)
+		fail("%u detection attempts: Not backing off", g_stats.detect_attempts);
+	if (g_stats.detect_attempts < seconds * 1000 / 300 - 10)
+		fail("%u detection attempts: Not retrying", g_stats.detect_attempts);
+	if (g_stats.polls)
+		fail("%u polls without a controller", g_stats.polls);
+}
+
+static void checkUnplugGc(void)
+{
+	expectFound(0, 1500);
+	if (!observed[0].reports)
+		fail("no reports");
+	expectLost(1, 50);
+	expectFound(2, 400);
+	if (g_stats.disconnects != 1)
+		fail("%u disconnects instead of 1", g_stats.disconnects);
+}
+
+static void checkNoisyN64(void)
+{
+	expectFound(0, 1500);
+	if (g_stats.disconnects)
+		fail("%u disconnects", g_stats.disconnects);
+	if (!g_stats.poll_errors)
+		fail("no poll errors");
+	if (!g_stats.link_glitches)
+		fail("no link glitches");
+}
+
+static void checkReleased(void)
+{
+	expectFound(0, 1500);
+	if (observed[0].first_release)
+		fail("step 0: released while held");
+	expectLost(1, 50);
+	expectReleased(1, 50);
+}
+
+static void checkNoise(void)
+{
+	expectFound(1, 1500);
+}
+
+static void checkNothing(void)
+{
+}
+
+static Scenario scenarios[] = {
+	{ "absent", 20000, { { 0, DEV_NONE } }, checkAbsent },
+	{ "unplug_gc", 8000, {
+		{ 0, DEV_GC },
+		{ 3000, DEV_NONE },
+		{ 5000, DEV_GC } }, checkUnplugGc },
+	{ "noisy_n64", 10000, { { 0, DEV_N64, 2, 10 } }, checkNoisyN64 },
+	{ "release_kb", 3000, {
+		{ 0, DEV_KB },
+		{ 2000, DEV_NONE } }, checkReleased },
+	{ "release_mouse", 3000, {
+		{ 0, DEV_MOUSE },
+		{ 2000, DEV_NONE } }, checkReleased },
+	{ "noise", 8000, {
+		{ 0, DEV_NOISE },
+		{ 5000, DEV_GC } }, checkNoise },
+};
+#define NUM_SCENARIOS	(sizeof(scenarios) / sizeof(scenarios[0]))
+
+/* Random plugging and unplugging, with bad replies. Only the
+ * common checks apply. */
+#define NUM_RANDOM		20
+
+static void randomScenario(Scenario *s, int n)
+{
+	static char names[NUM_RANDOM][16];
+	unsigned long ms = 0;
+	int i;
+
+	srand(n);
+	snprintf(names[n], sizeof(names[n]), "random%d", n);
+	memset(s, 0, sizeof(Scenario));
+	s->name = names[n];
+	s->check = checkNothing;
+	s->seed = n;
+
+	for (i=0; i<MAX_STEPS; i++) {
+		s->steps[i].ms = ms;
+		s->steps[i].dev = rand() % NUM_DEVS;
+		s->steps[i].drop_pct = rand() % 3 ? 0 : rand() % 30;
+		s->steps[i].corrupt_pct = rand() % 3 ? 0 : rand() % 30;
+		ms += 50 + rand() % 1500;
+	}
+	s->duration_ms = ms;
+}
+
+static int run(const Scenario *s)
+{
+	scenario = s;
+	for (num_steps = 1; num_steps < MAX_STEPS && s->steps[num_steps].ms; num_steps++)
+		;
+	end_time = s->duration_ms * MS;
+
+	srand(s->seed);
+	memset(host_eeprom, 0xff, sizeof(host_eeprom)); // Blank
+	host_controller = controller;
+	host_usbPolled = usbPolled;
+	host_usbReport = usbReport;
+	host_watchdog = watchdog;
+
+	if (!setjmp(done)) {
+		firmware_main();
+		fail("firmware_main() returned");
+	}
+
+	s->check();
+
+	trace("max. usbPoll() gap %.1fms, polls %u (%u failed), reports %u, "
+			"disconnects %u, glitches %u, detection attempts %u",
+			max_usbpoll_gap / 1e6, g_stats.polls, g_stats.poll_errors,
+			g_stats.reports, g_stats.disconnects, g_stats.link_glitches,
+			g_stats.detect_attempts);
+
+	return failures;
+}
+
+/* In a child process, as the firmware state cannot be reset */
+static int runChild(const Scenario *s)
+{
+	pid_t pid;
+	int status;
+
+	fflush(stdout);
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return 1;
+	}
+	if (pid == 0) {
+		exit(run(s) ? 1 : 0);
+	}
+
+	waitpid(pid, &status, 0);
+	if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+		printf("FAIL %s\n", s->name);
+		return 1;
+	}
+	printf("ok   %s\n", s->name);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	Scenario random_scenarios[NUM_RANDOM];
+	const char *name = NULL;
+	int i, failed = 0, found = 0;
+
+	for (i=1; i<argc; i++) {
+		if (!strcmp(argv[i], "-v"))
+			verbose = 1;
+		else
+			name = argv[i];
+	}
+
+	for (i=0; i<NUM_RANDOM; i++) {
+		randomScenario(&random_scenarios[i], i);
+	}
+
+	for (i=0; i<NUM_SCENARIOS + NUM_RANDOM; i++) {
+		const Scenario *s = i < NUM_SCENARIOS ? &scenarios[i] : &random_scenarios[i - NUM_SCENARIOS];
+
+		if (name && strcmp(name, s->name))
+			continue;
+		found++;
+		failed += runChild(s);
+	}
+
+	if (!found) {
+		fprintf(stderr, "%s: no such scenario\n", name);
+		return 1;
+	}
+
+	printf("sim: %d of %d scenario(s) failed\n", failed, found);
+	return failed ? 1 : 0;
+}
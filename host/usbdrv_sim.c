@@ -0,0 +1,52 @@
+/* Host builds: Stands in for the V-USB driver (usbdrv.c).
+ *
+ * The host reads the interrupt endpoint every USB_CFG_INTR_POLL_INTERVAL
+ * ms. Control transfers are not simulated: tests call usbFunctionSetup()
+ * and the others directly.
+ */
+#include <string.h>
+#include "usbdrv.h"
+#include "host.h"
+#include "usbdrv_sim.h"
+
+usbMsgPtr_t usbMsgPtr;
+usbTxStatus_t usbTxStatus1;
+
+unsigned char host_usbRunning;
+void (*host_usbPolled)(void);
+void (*host_usbReport)(const unsigned char *data, unsigned char len);
+
+/* A main loop pass (usbPoll() and the doTasks functions) */
+#define POLL_NS			10000
+#define INTR_INTERVAL	(USB_CFG_INTR_POLL_INTERVAL * 1000000ULL)
+
+static unsigned long long fetch_at;
+
+void usbInit(void)
+{
+	usbTxLen1 = USBPID_NAK;
+	host_usbRunning = 1;
+}
+
+void usbSetInterrupt(uchar *data, uchar len)
+{
+	memcpy(usbTxBuf1, data, len);
+	usbTxLen1 = len;
+	fetch_at = host_now - host_now % INTR_INTERVAL + INTR_INTERVAL;
+}
+
+void usbPoll(void)
+{
+	host_advance(POLL_NS);
+
+	if (usbTxLen1 != USBPID_NAK && host_now >= fetch_at) {
+		unsigned char len = usbTxLen1;
+
+		usbTxLen1 = USBPID_NAK;
+		if (host_usbReport)
+			host_usbReport(usbTxBuf1, len);
+	}
+
+	if (host_usbPolled)
+		host_usbPolled();
+}
@@ -0,0 +1,13 @@
+#ifndef _usbdrv_sim_h__
+#define _usbdrv_sim_h__
+
+/* Set by usbInit() */
+extern unsigned char host_usbRunning;
+
+/* Called at the end of each usbPoll() */
+extern void (*host_usbPolled)(void);
+
+/* Called when the host reads the interrupt endpoint */
+extern void (*host_usbReport)(const unsigned char *data, unsigned char len);
+
+#endif // _usbdrv_sim_h__
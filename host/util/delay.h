@@ -0,0 +1,10 @@
+/* Host build: Delays advance the simulated clock */
+#ifndef _host_delay_h__
+#define _host_delay_h__
+
+#include "host.h"
+
+#define _delay_us(us)	host_advance((unsigned long)((us) * 1000))
+#define _delay_ms(ms)	host_advance((unsigned long)((ms) * 1000000))
+
+#endif // _host_delay_h__
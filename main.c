@@ -30,16 +30,20 @@
 #include "gamecube.h"
 #include "n64.h"
 #include "gc_kb.h"
+#include "n64_mouse.h"
 #include "gcn64_protocol.h"
+#include "config.h"
+#include "stats.h"
+#include "vendor.h"
+#include "serialno.h"
+#include "remap.h"
+#include "history.h"
 
 #include "devdesc.h"
 #include "reportdesc.h"
 
 #define MAX_REPORTS	2
 
-#undef NONSTOP_VIBRATION
-#undef WAIT_FOR_PAD
-
 #if defined(__AVR_ATmega168__) || defined(__AVR_ATmega168A__) || \
 	defined(__AVR_ATmega168P__) || defined(__AVR_ATmega328__) || \
 	defined(__AVR_ATmega328P__) || defined(__AVR_ATmega88__) || \
@@ -50,14 +54,12 @@
 
 static const uchar *rt_usbHidReportDescriptor=NULL;
 static int rt_usbHidReportDescriptorSize=0;
+static const uchar *rt_usbHidReportDescriptorTail=NULL;
+static int rt_usbHidReportDescriptorTailSize=0;
+static int report_desc_offset; /* Position in the two part report descriptor */
 static uchar *rt_usbDeviceDescriptor=NULL;
 static uchar rt_usbDeviceDescriptorSize=0;
 
-PROGMEM const int usbDescriptorStringSerialNumber[] = {
-	USB_STRING_DESCRIPTOR_HEADER(USB_CFG_SERIAL_NUMBER_LENGTH),
-	'0', '0', '0', '1'
-};
-
 char usbDescriptorConfiguration[] = { 0 }; // dummy
 
 uchar my_usbDescriptorConfiguration[] = {    /* USB configuration descriptor */
@@ -81,8 +83,8 @@ uchar my_usbDescriptorConfiguration[] = {    /* USB configuration descriptor */
     0,          /* alternate setting for this interface */
     USB_CFG_HAVE_INTRIN_ENDPOINT,   /* endpoints excl 0: number of endpoint descriptors to follow */
     USB_CFG_INTERFACE_CLASS,
-    USB_CFG_INTERFACE_SUBCLASS,
-    USB_CFG_INTERFACE_PROTOCOL,
+/* 15 */    USB_CFG_INTERFACE_SUBCLASS, /* Updated at run-time for boot devices */
+/* 16 */    USB_CFG_INTERFACE_PROTOCOL,
     0,          /* string index for interface */
 //#if (USB_CFG_DESCR_PROPS_HID & 0xff)    /* HID descriptor */
     9,          /* sizeof(usbDescrHID): length of descriptor in bytes */
@@ -106,11 +108,22 @@ uchar my_usbDescriptorConfiguration[] = {    /* USB configuration descriptor */
 
 
 
+Gamepad g_gamepad;
 static Gamepad *curGamepad = NULL;
+static unsigned char cur_controller; // CONTROLLER_IS_*, valid when curGamepad is set
+/* Size of the all released report to send once after a keyboard or a
+ * mouse is lost. Otherwise the host keeps the last keys or buttons down. */
+static unsigned char release_report_size;
 
 
 /* ----------------------- hardware I/O abstraction ------------------------ */
 
+#if defined(AT168_COMPATIBLE)
+	#define setPollPeriod(p)	do { OCR2A = (p); } while(0)
+#else
+	#define setPollPeriod(p)	do { OCR2 = (p); } while(0)
+#endif
+
 static void hardwareInit(void)
 {
 	/* PORTB
@@ -151,12 +164,16 @@ static void hardwareInit(void)
 	TCCR0B = 5;
 	TCCR2A= (1<<WGM21);
 	TCCR2B=(1<<CS22)|(1<<CS21)|(1<<CS20);
-	OCR2A= 50;  // for 240 hz
 #else
 	TCCR0 = 5; // divide by 1024
 	TCCR2 = (1<<WGM21)|(1<<CS22)|(1<<CS21)|(1<<CS20);
-	OCR2 = 50; // for 240 hz
 #endif
+	setPollPeriod(g_config.poll_period);
+
+	/* Timer1 is free running at 187.5kHz (5.33us per tick).
+	 * It is used for timing statistics. */
+	TCCR1A = 0;
+	TCCR1B = (1<<CS11)|(1<<CS10); // divide by 64
 
 }
 
@@ -187,6 +204,10 @@ static void usbReset(void)
 #endif
 
 static uchar    reportBuffer[10];    /* buffer for HID reports */
+static uchar    hid_protocol = 1;    /* 0: boot protocol, 1: report protocol */
+static uchar    vendor_request;      /* Non-zero when the current control transfer is a vendor request */
+static usbMsgLen_t set_report_remaining; /* SET_REPORT: Data stage bytes not received yet */
+static uchar    set_report_started;  /* SET_REPORT: The first packet (with the report ID) was received */
 
 
 
@@ -210,12 +231,26 @@ usbMsgLen_t   usbFunctionDescriptor(struct usbRequest *rq)
 				return rt_usbDeviceDescriptorSize;
 
 			case USBDESCR_HID_REPORT:
+				if (rt_usbHidReportDescriptorTail) {
+					// Sent from usbFunctionRead(). Not through
+					// usbFunctionSetup(), so clear vendor_request here.
+					report_desc_offset = 0;
+					vendor_request = 0;
+					return USB_NO_MSG;
+				}
 				usbMsgPtr = (void*)rt_usbHidReportDescriptor;
 				return rt_usbHidReportDescriptorSize;
 
 			case USBDESCR_CONFIG:
 				usbMsgPtr = (usbMsgPtr_t)my_usbDescriptorConfiguration;
 				return sizeof(my_usbDescriptorConfiguration);
+
+			case USBDESCR_STRING:
+				if (rq->wValue.bytes[0] == 3) { // serial number
+					usbMsgPtr = (usbMsgPtr_t)usbDescriptorStringSerialNumber;
+					return 2 + SERIALNO_LENGTH * 2;
+				}
+				break;
 		}
 	}
 
@@ -232,7 +267,17 @@ static void gamepadVibrate(char on)
 static int getGamepadReport(unsigned char *dstbuf, int id)
 {
 	if (curGamepad == NULL) {
-		if (id==1) {
+		if (id==1 && rt_usbHidReportDescriptor == (void*)n64_usbHidReportDescriptor) {
+			// Still enumerated as a N64 controller
+			dstbuf[0] = 1;
+			dstbuf[1] = 0x7f;
+			dstbuf[2] = 0x7f;
+			dstbuf[3] = 0;
+			dstbuf[4] = 0;
+
+			return N64_REPORT_SIZE;
+		}
+		if (id==1 && rt_usbHidReportDescriptor == (void*)gcn64_usbHidReportDescriptor) {
 			dstbuf[0] = 1;
 			dstbuf[1] = 0x7f;
 			dstbuf[2] = 0x7f;
@@ -245,6 +290,14 @@ static int getGamepadReport(unsigned char *dstbuf, int id)
 
 			return 9;
 		}
+		if (release_report_size) {
+			int len = release_report_size;
+
+			memset(dstbuf, 0, len);
+			release_report_size = 0;
+			return len;
+		}
+		// Keyboard or mouse: Nothing pressed, nothing to report.
 		return 0;
 	}
 	else {
@@ -255,6 +308,7 @@ static int getGamepadReport(unsigned char *dstbuf, int id)
 static unsigned char _FFB_effect_index;
 #define LOOP_MAX	0xFFFF
 static unsigned int _loop_count;
+static unsigned char rumble_test_count; // ACTION_RUMBLE_TEST
 
 static void effect_loop()
 {
@@ -263,6 +317,9 @@ static void effect_loop()
 			_loop_count--;
 		}
 	}
+	if (rumble_test_count) {
+		rumble_test_count--;
+	}
 }
 
 // Output Report IDs for various functions
@@ -287,6 +344,8 @@ usbMsgLen_t	usbFunctionSetup(uchar data[8])
 	usbRequest_t    *rq = (void *)data;
 
 	usbMsgPtr = reportBuffer;
+	vendor_request = 0;
+	set_report_remaining = 0;
 	if((rq->bmRequestType & USBRQ_TYPE_MASK) == USBRQ_TYPE_CLASS){    /* class request type */
 
 		switch(rq->bRequest)
@@ -344,18 +403,64 @@ usbMsgLen_t	usbFunctionSetup(uchar data[8])
 					}
 #endif
 				}
+				break;
 
 			case USBRQ_HID_SET_REPORT:
-				{
-					return USB_NO_MSG;
-				}
+				// Received by usbFunctionWrite()
+				if ((rq->bmRequestType & USBRQ_DIR_MASK) != USBRQ_DIR_HOST_TO_DEVICE)
+					break;
+				if (!rq->wLength.word)
+					break;
+				set_report_remaining = rq->wLength.word;
+				set_report_started = 0;
+				return USB_NO_MSG;
+
+			/* Boot devices use the same report format for both
+			 * protocols, so the selection only needs to be remembered. */
+			case USBRQ_HID_GET_PROTOCOL:
+				reportBuffer[0] = hid_protocol;
+				return 1;
+
+			case USBRQ_HID_SET_PROTOCOL:
+				hid_protocol = rq->wValue.bytes[0];
+				return 0;
 		}
-	}else{
-	/* no vendor specific requests implemented */
+	}else if((rq->bmRequestType & USBRQ_TYPE_MASK) == USBRQ_TYPE_VENDOR){
+		vendor_request = 1;
+		return vendor_setup(rq, curGamepad && cur_controller == CONTROLLER_IS_N64);
 	}
 	return 0;
 }
 
+/* Copy the next part of the report descriptor, which is
+ * the descriptor and its tail one after the other. */
+static uchar readReportDescriptor(uchar *data, uchar len)
+{
+	uchar i;
+	int total = rt_usbHidReportDescriptorSize + rt_usbHidReportDescriptorTailSize;
+
+	for (i=0; i<len && report_desc_offset < total; i++, report_desc_offset++) {
+		if (report_desc_offset < rt_usbHidReportDescriptorSize) {
+			data[i] = pgm_read_byte(rt_usbHidReportDescriptor + report_desc_offset);
+		} else {
+			data[i] = pgm_read_byte(rt_usbHidReportDescriptorTail +
+								report_desc_offset - rt_usbHidReportDescriptorSize);
+		}
+	}
+
+	return i;
+}
+
+uchar usbFunctionRead(uchar *data, uchar len)
+{
+	// Used by vendor requests and for sending the report descriptor.
+	// Vendor requests go through usbFunctionSetup, descriptors do not.
+	if (vendor_request)
+		return vendor_read(data, len);
+
+	return readReportDescriptor(data, len);
+}
+
 
 static unsigned char vibration_on = 0;
 static unsigned char constant_force = 0;
@@ -363,10 +468,15 @@ static unsigned char magnitude = 0;
 
 static void decideVibration(void)
 {
-#ifdef NONSTOP_VIBRATION
-	gamepadVibrate(1);
-	return;
-#endif
+	if (g_config.flags & CFG_FLAG_NONSTOP_VIBRATION) {
+		gamepadVibrate(1);
+		return;
+	}
+
+	if (rumble_test_count) {
+		gamepadVibrate(1);
+		return;
+	}
 
 	if (!_loop_count)
 		vibration_on = 0;
@@ -385,12 +495,12 @@ static void decideVibration(void)
 	}
 }
 
-uchar usbFunctionWrite(uchar *data, uchar len)
+/* Output reports (force feedback). Only the first packet is
+ * looked at. The fields used are in the first 4 bytes. */
+static void handleOutputReport(uchar *data, uchar len)
 {
-	if (len < 1)
-		return 1;
-
-	//
+	if (len < 2)
+		return;
 
 	switch(data[0]) // Report ID
 	{
@@ -413,6 +523,8 @@ uchar usbFunctionWrite(uchar *data, uchar len)
 			break;
 
 		case REPORT_SET_CONSTANT_FORCE:
+			if (len < 3)
+				break;
 			if (data[1]==1) {
 				constant_force = data[2];
 				decideVibration();
@@ -420,13 +532,15 @@ uchar usbFunctionWrite(uchar *data, uchar len)
 			break;
 
 		case REPORT_SET_PERIODIC:
+			if (len < 3)
+				break;
 			magnitude = data[2];
 			decideVibration();
 			break;
 
 		case REPORT_EFFECT_OPERATION:
 			if (len != 4)
-				return 1;
+				break;
 
 			/* Byte 0 : report ID
 			 * Byte 1 : bit 7=rom flag, bits 6-0=effect block index
@@ -477,13 +591,41 @@ uchar usbFunctionWrite(uchar *data, uchar len)
 
 			break;
 	}
+}
 
-	return 1;
+uchar usbFunctionWrite(uchar *data, uchar len)
+{
+	if (vendor_request)
+		return vendor_write(data, len);
+
+	if (!set_report_remaining)
+		return 0xff; // unexpected data
+
+	/* Reports longer than 8 bytes arrive in several packets. Only
+	 * the first one starts with the report ID. */
+	if (len > set_report_remaining)
+		len = set_report_remaining;
+	set_report_remaining -= len;
+
+	if (!set_report_started) {
+		set_report_started = 1;
+		handleOutputReport(data, len);
+	}
+
+	return set_report_remaining ? 0 : 1;
 }
 
 /* ------------------------------------------------------------------------- */
 
-void transferGamepadReport(int id)
+/* usbPoll() must be called at least every 50ms. */
+static void pollUsb(void)
+{
+	usbPoll();
+	stats_usbPolled();
+}
+
+/* Returns non-zero if the report was sent */
+char transferGamepadReport(int id)
 {
 	if (usbInterruptIsReady())
 	{
@@ -499,13 +641,17 @@ void transferGamepadReport(int id)
 
 			while (!usbInterruptIsReady())
 			{
-				usbPoll();
+				pollUsb();
 				wdt_reset();
 			}
 			usbSetInterrupt(reportBuffer+j, xfer_len);
 
 		}
+		g_stats.reports++;
+		return 1;
 	}
+
+	return 0;
 }
 
 static void sleepsync(void)
@@ -518,30 +664,164 @@ static void sleepsync(void)
 	wdt_enable(WDTO_2S);
 }
 
+/* When the transmit timings were switched automatically (see linkError())
+ * and polling works again, make the choice persistent for this family. */
+static void rememberTimings(void)
+{
+	unsigned char family = gcn64_getFamily();
+
+	if (gcn64_getTimings() != g_config.tx_timings[family]) {
+		config_saveTxTimings(family, gcn64_getTimings());
+	}
+}
+
+/* Controller link state
+ *
+ * PRESENT: Polls succeed.
+ * DEGRADED: Recent polls failed. The last good report is held, nothing
+ * 		is sent until the controller answers properly again.
+ * LOST: curGamepad is NULL. Detection is retried, waiting longer after
+ * 		each failed attempt (up to DETECT_BACKOFF_MAX poll periods).
+ *
+ * An unplugged controller does not answer at all, so a few unanswered polls
+ * are enough to drop it. Corrupted replies are tolerated for much longer.
+ */
+#define LINK_PRESENT		0
+#define LINK_DEGRADED		1
+#define LINK_LOST			2
+
+#define LINK_MAX_UNANSWERED	4	// ~17ms at 240Hz
+#define LINK_MAX_ERRORS		30
+#define LINK_ERRORS_BEFORE_SWITCH	8 // Try the other timings (CFG_FLAG_AUTO_TIMINGS)
+#define DETECT_BACKOFF_MAX	64	// ~270ms at 240Hz
+
+static unsigned char link_state = LINK_LOST;
+static unsigned char link_errors;
+static unsigned char link_unanswered;
+static unsigned char detect_backoff;
+static unsigned char detect_wait;
+
+static void linkPresent(void)
+{
+	if (link_state == LINK_DEGRADED)
+		g_stats.link_glitches++;
+
+	link_state = LINK_PRESENT;
+	link_errors = 0;
+	link_unanswered = 0;
+}
+
+static void linkLost(void)
+{
+	link_state = LINK_LOST;
+	if (curGamepad) {
+		if (curGamepad->bootProtocol == HID_BOOT_PROTOCOL_KEYBOARD)
+			release_report_size = HID_BOOT_KEYBOARD_REPORT_SIZE;
+		else if (curGamepad->bootProtocol == HID_BOOT_PROTOCOL_MOUSE)
+			release_report_size = HID_BOOT_MOUSE_REPORT_SIZE;
+	}
+	curGamepad = NULL;
+	g_stats.disconnects++;
+
+	// In case the host stopped reading the history midway
+	history_freeze(0);
+
+	// Unplugging is not a reason to change timings
+	gcn64_selectTimings(gcn64_getFamily());
+
+	// Try again right away, in case this was a glitch after all
+	detect_backoff = 0;
+	detect_wait = 0;
+}
+
+static void linkError(void)
+{
+	link_state = LINK_DEGRADED;
+	link_errors++;
+
+	if (gcn64_lastTransactionUnanswered()) {
+		link_unanswered++;
+	} else {
+		link_unanswered = 0;
+	}
+
+	if (link_unanswered >= LINK_MAX_UNANSWERED || link_errors >= LINK_MAX_ERRORS) {
+		linkLost();
+		return;
+	}
+
+	/* Only consecutive failures with an identified controller count.
+	 * An unplugged controller is lost before reaching this. */
+	if ((g_config.flags & CFG_FLAG_AUTO_TIMINGS) &&
+			!(link_errors % LINK_ERRORS_BEFORE_SWITCH)) {
+		gcn64_toggleTimings();
+	}
+}
+
+/* Detection takes time (and even more when the controller gives unexpected
+ * replies). Without a controller, it is attempted at the poll rate at
+ * first, then less and less often. */
+static char detectionDue(void)
+{
+	if (!mustPollControllers())
+		return 0;
+	clrPollControllers();
+
+	if (detect_wait) {
+		detect_wait--;
+		return 0;
+	}
+
+	if (detect_backoff < DETECT_BACKOFF_MAX) {
+		detect_backoff = detect_backoff ? detect_backoff * 2 : 1;
+	}
+	detect_wait = detect_backoff;
+	g_stats.detect_attempts++;
+
+	return 1;
+}
+
 /* Poll the controller
  * Send reports
  */
 static void controller_present_doTasks(char just_changed)
 {{{
 	char must_report = 0;
-	static int error_count = 0;
 	int i;
+	unsigned short t;
+	unsigned char action, action_arg;
+	char error;
 
 	/* main event loop */
 	wdt_reset();
 
 	// this must be called at each 50 ms or less
-	usbPoll();
+	pollUsb();
 
 	if (just_changed) {
 		gamepadVibrate(0);
-		error_count = 0;
+		linkPresent();
+	}
+
+	action = vendor_getAction(&action_arg);
+	switch (action)
+	{
+		case ACTION_RECALIBRATE:
+			sleepsync();
+			curGamepad->init();
+			break;
+
+		case ACTION_RUMBLE_TEST:
+			rumble_test_count = action_arg;
+			decideVibration();
+			break;
 	}
 
 	/* Poll the controller at the configured speed */
 	if (mustPollControllers())
 	{
 		clrPollControllers();
+		setPollPeriod(g_config.poll_period);
 		
 		if (!must_report)
 		{
@@ -563,18 +843,35 @@ static void controller_present_doTasks(char just_changed)
 			//
 			sleepsync();
 
-			if (curGamepad->update()) {
-				error_count++;
+			t = TCNT1;
+			error = curGamepad->update();
+			if (error) {
+				g_stats.poll_errors++;
 			} else {
-				error_count = 0;
+				linkPresent();
+				rememberTimings();
+			}
+			if (g_config.flags & CFG_FLAG_HISTORY) {
+				history_add(t, error);
 			}
+			t = TCNT1 - t;
+
+			g_stats.polls++;
+			g_stats.poll_time_last = t;
+			if (t > g_stats.poll_time_max)
+				g_stats.poll_time_max = t;
 
 			/* Check what will have to be reported */
-			for (i=0; i<curGamepad->num_reports; i++) {
+			for (i=0; !error && i<curGamepad->num_reports; i++) {
 				if (curGamepad->changed(i+1)) {
 					must_report |= (1<<i);
 				}
 			}
+
+			if (error) {
+				linkError(); // may clear curGamepad
+				return;
+			}
 		}
 
 	}
@@ -594,16 +891,15 @@ static void controller_present_doTasks(char just_changed)
 				continue;
 
 
-			transferGamepadReport(i+1);
+			// Only reports built from a poll go in the history, not
+			// the idle reports sent while no controller is present.
+			if (transferGamepadReport(i+1) && (g_config.flags & CFG_FLAG_HISTORY)) {
+				history_markSent();
+			}
 		}
 
 		must_report = 0;
 	}
-
-	// Detect disconnection
-	if (error_count > 30) {
-		curGamepad = NULL;
-	}
 }}}
 
 Gamepad *tryDetectController(void)
@@ -613,49 +909,63 @@ Gamepad *tryDetectController(void)
 	gamepadVibrate(0);
 
 	// this must be called at each 50 ms or less
-	usbPoll();
+	pollUsb();
 	transferGamepadReport(1); // We know they all have only one
-	usbPoll();
+	pollUsb();
 //	_delay_ms(10);
 	if (SREG & 0x80) {
 		sleepsync();
 	}
 
-	switch(gcn64_detectController())
+	cur_controller = gcn64_detectController();
+	switch(cur_controller)
 	{
 		case CONTROLLER_IS_N64:
+			gcn64_selectTimings(GCN64_FAMILY_N64);
 			pad = n64GetGamepad();
 			pad->init();
 			break;
 
 		case CONTROLLER_IS_GC:
+			gcn64_selectTimings(GCN64_FAMILY_GC);
 			pad = gamecubeGetGamepad();
 			pad->init();
 			break;
 
 		case CONTROLLER_IS_GC_KEYBOARD:
+			gcn64_selectTimings(GCN64_FAMILY_GC);
 			pad = gc_kb_getGamepad();
 			pad->init();
 			break;
 
+		case CONTROLLER_IS_N64_MOUSE:
+			gcn64_selectTimings(GCN64_FAMILY_N64);
+			pad = n64_mouse_getGamepad();
+			pad->init();
+			break;
+
 			// Unknown means weird reply from the controller
 			// try the old, bruteforce approach.
 		case CONTROLLER_IS_UNKNOWN:
 			/* Check for gamecube controller */
+			gcn64_selectTimings(GCN64_FAMILY_GC);
 			pad = gamecubeGetGamepad();
 			pad->init();
 			if (pad->probe()) {
+				cur_controller = CONTROLLER_IS_GC;
 				break;
 			}
 
-			usbPoll();
+			pollUsb();
 			_delay_ms(40);
-			usbPoll();
+			pollUsb();
 
 			/* Check for n64 controller */
+			gcn64_selectTimings(GCN64_FAMILY_N64);
 			pad = n64GetGamepad();
 			pad->init();
 			if (pad->probe())  {
+				cur_controller = CONTROLLER_IS_N64;
 				break;
 			}
 
@@ -670,26 +980,40 @@ int main(void)
 {
 	char just_detected = 1;
 	Gamepad *pad = NULL;
+	int desc_size;
 
+	/* After a watchdog reset, the watchdog stays enabled (with the
+	 * shortest timeout on some devices) until WDRF is cleared. */
+#if defined(AT168_COMPATIBLE)
+	g_stats.reset_cause = MCUSR;
+	MCUSR = 0;
+#else
+	g_stats.reset_cause = MCUCSR;
+	MCUCSR = 0;
+#endif
+	wdt_disable();
+
+	config_init();
 	hardwareInit();
+	serialno_init();
 	gcn64protocol_hwinit();
 
-#ifdef WAIT_FOR_PAD
-	do {
-		pad = tryDetectController();
-	} while (pad == NULL);
-	curGamepad = pad;
-#else
-	int i = 60;
-	do {
-		pad = tryDetectController();
-		if (pad) {
-			curGamepad = pad;
-			break;
-		}
-		_delay_ms(16);
-	} while (--i);
-#endif
+	if (g_config.flags & CFG_FLAG_WAIT_FOR_PAD) {
+		do {
+			pad = tryDetectController();
+		} while (pad == NULL);
+		curGamepad = pad;
+	} else {
+		int i = 60;
+		do {
+			pad = tryDetectController();
+			if (pad) {
+				curGamepad = pad;
+				break;
+			}
+			_delay_ms(16);
+		} while (--i);
+	}
 
 reconnect:
 	cli();
@@ -697,9 +1021,13 @@ reconnect:
 	if (curGamepad && curGamepad->reportDescriptor) {
 		rt_usbHidReportDescriptor = curGamepad->reportDescriptor;
 		rt_usbHidReportDescriptorSize = curGamepad->reportDescriptorSize;
+		rt_usbHidReportDescriptorTail = curGamepad->reportDescriptorTail;
+		rt_usbHidReportDescriptorTailSize = curGamepad->reportDescriptorTailSize;
 	} else {
 		rt_usbHidReportDescriptor = (void*)gcn64_usbHidReportDescriptor;
 		rt_usbHidReportDescriptorSize = getUsbHidReportDescriptor_size();
+		rt_usbHidReportDescriptorTail = (void*)gcn64_pidReportDescriptor;
+		rt_usbHidReportDescriptorTailSize = getPidReportDescriptor_size();
 	}
 
 	if (curGamepad && curGamepad->deviceDescriptor) {
@@ -711,8 +1039,20 @@ reconnect:
 	}
 
 	// patch the config descriptor with the HID report descriptor size
-	my_usbDescriptorConfiguration[25] = rt_usbHidReportDescriptorSize;
-	my_usbDescriptorConfiguration[26] = rt_usbHidReportDescriptorSize >> 8;
+	desc_size = rt_usbHidReportDescriptorSize + rt_usbHidReportDescriptorTailSize;
+	my_usbDescriptorConfiguration[25] = desc_size;
+	my_usbDescriptorConfiguration[26] = desc_size >> 8;
+
+	// and declare a boot interface if the device supports it
+	if (curGamepad && curGamepad->bootProtocol) {
+		my_usbDescriptorConfiguration[15] = 1; // Boot interface subclass
+		my_usbDescriptorConfiguration[16] = curGamepad->bootProtocol;
+	} else {
+		my_usbDescriptorConfiguration[15] = USB_CFG_INTERFACE_SUBCLASS;
+		my_usbDescriptorConfiguration[16] = USB_CFG_INTERFACE_PROTOCOL;
+	}
+	hid_protocol = 1; // Report protocol after reset (HID 1.11 section 7.2.6)
+	release_report_size = 0; // The USB reset releases everything
 
 	// Do hardwareInit again. It causes a USB reset.
 
@@ -723,10 +1063,19 @@ reconnect:
 
 	while (1)
 	{
-		usbPoll();
+		pollUsb();
 		wdt_reset();
+		config_doTasks();
+		serialno_doTasks();
+		remap_doTasks();
+		vendor_doTasks();
 
 		if (curGamepad == NULL) {
+			// Not for a controller found later
+			vendor_clearAction();
+		}
+
+		if (curGamepad == NULL && detectionDue()) {
 			pad = tryDetectController();
 			if (pad) {
 				curGamepad = pad;
@@ -16,6 +16,7 @@
 */
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 #include <util/delay.h>
 #include <string.h>
 #include "gamepad.h"
@@ -23,6 +24,11 @@
 #include "n64.h"
 #include "reportdesc.h"
 #include "gcn64_protocol.h"
+#include "axis.h"
+#include "config.h"
+#include "remap.h"
+#include "n64_pak.h"
+#include "stats.h"
 #include "usbdrv.h"
 
 #undef BUTTON_A_RUMBLE_TEST
@@ -34,74 +40,97 @@ static char n64Changed(int id);
 static int n64BuildReport(unsigned char *reportBuffer, int id);
 static void n64SetVibration(int value);
 
+#define N64_AXIS_CENTER	0x7f
+#define N64_AXIS_RANGE	80 // Typical, stretched to the full report range
+
 static char must_rumble = 0;
 #ifdef BUTTON_A_RUMBLE_TEST
 static char force_rumble = 0;
 #endif
 
 /* What was most recently read from the controller */
-static unsigned char last_built_report[GCN64_REPORT_SIZE];
+static unsigned char last_built_report[N64_REPORT_SIZE];
 
 /* What was most recently sent to the host */
-static unsigned char last_sent_report[GCN64_REPORT_SIZE];
+static unsigned char last_sent_report[N64_REPORT_SIZE];
+
+/* Buttons pressed since the last report was sent (CFG_FLAG_COALESCE_BUTTONS) */
+static unsigned char latched_buttons[2];
+
+/* The pak is identified once, when inserted. The result
+ * is kept until the controller reports its removal. */
+static unsigned char pak_type = N64_PAK_TYPE_NONE;
+static unsigned char pak_probes;
+#define PAK_MAX_PROBES	3 // Identification attempts per insertion. Then assume a rumble pak.
 
 static void n64Init(void)
 {
 	// rumble on debug
 	DDRC |= 0x01; // PC0
 	PORTC &= ~0x01;
+	pak_type = N64_PAK_TYPE_NONE;
+	pak_probes = 0;
+	remap_load(REMAP_N64);
 	n64Update();
 }
 
-#define RSTATE_INIT			0
+/* Rumble pak state. Only used when pak_type is N64_PAK_TYPE_RUMBLE.
+ * TURNON and TURNOFF: Write pending. */
 #define RSTATE_OFF			1
 #define RSTATE_TURNON		2
 #define RSTATE_ON			3
 #define RSTATE_TURNOFF		4
-#define RSTATE_UNAVAILABLE	5
-static unsigned char n64_rumble_state = RSTATE_UNAVAILABLE;
-unsigned char tmpdata[40];
+static unsigned char n64_rumble_state = RSTATE_TURNOFF;
 
-static char initRumble(void)
-{
-	int count;
+/* Each rumble pak write is a long transaction. Games switching the motor
+ * on and off quickly would otherwise cause one at almost every poll.
+ * Writes are spaced by at least g_config.rumble_interval. Changes made
+ * meanwhile are coalesced: only the final state is written. */
+#define T1_TICKS_PER_MS	(F_CPU / 64000)
+static unsigned short last_rumble_write;
+static unsigned char rumble_write_allowed = 1;
 
-	tmpdata[0] = N64_EXPANSION_WRITE;
-	tmpdata[1] = 0x80;
-	tmpdata[2] = 0x01;
-	memset(tmpdata+3, 0x80, 32);
+static char rumbleWriteAllowed(void)
+{
+	// Remembered, as Timer1 wraps every 350ms
+	if ((unsigned short)(TCNT1 - last_rumble_write) >=
+			(unsigned short)g_config.rumble_interval * T1_TICKS_PER_MS) {
+		rumble_write_allowed = 1;
+	}
 
-	/* Note: The old test (count > 0) was not reliable. */
-	count = gcn64_transaction(tmpdata, 35);
-	if (count == 8)
-		return 0;
+	return rumble_write_allowed;
+}
+unsigned char tmpdata[N64_PAK_WRITE_HEADER + N64_PAK_BLOCK_SIZE];
 
-	return -1;
+/* Enable a rumble pak which could not be identified. Writes only, like
+ * before identification existed, so rumble works even if reading does not. */
+static char initRumble(void)
+{
+	memset(tmpdata + N64_PAK_WRITE_HEADER, 0x80, N64_PAK_BLOCK_SIZE);
+	return n64_pak_writeBlock(0x8000, tmpdata);
 }
 
+/* Returns N64_PAK_OK or an error (see n64_pak.h). The reply (data CRC)
+ * is checked, so success means the pak did receive the data. The rumble
+ * pak is initialized by n64_pak_identify() or initRumble(). */
 static char controlRumble(char enable)
 {
-	int count;
-
-	tmpdata[0] = N64_EXPANSION_WRITE;
-	tmpdata[1] = 0xc0;
-	tmpdata[2] = 0x1b;
-	memset(tmpdata+3, enable ? 0x01 : 0x00, 32);
-	count = gcn64_transaction(tmpdata, 35);
-	if (count == 8)
-		return 0;
-
-	return -1;
+	last_rumble_write = TCNT1;
+	rumble_write_allowed = 0;
+	memset(tmpdata + N64_PAK_WRITE_HEADER, enable ? 0x01 : 0x00, N64_PAK_BLOCK_SIZE);
+	return n64_pak_writeBlock(0xC000, tmpdata);
 }
 
 static char n64Update(void)
 {
-	int i;
 	unsigned char count;
 	unsigned char x,y;
 	unsigned char btns1, btns2;
 	unsigned char rb1, rb2;
+	unsigned short buttons;
+	unsigned char axes[GCN64_NUM_AXES], mapped[GCN64_NUM_AXES];
 	unsigned char caps[3];
+	char res;
 
 	/* Pad answer to N64_GET_CAPABILITIES
 	 *
@@ -115,9 +144,8 @@ static char n64Update(void)
 	tmpdata[0] = N64_GET_CAPABILITIES;
 	count = gcn64_transaction(tmpdata, 1);
 	if (count != N64_CAPS_REPLY_LENGTH) {
-		// a failed read could mean the pack or controller was gone. Init
-		// will be necessary next time we detect a pack is present.
-		n64_rumble_state = RSTATE_INIT;
+		// If the pak was pulled out meanwhile, the removed
+		// bit will be set next time.
 		return -1;
 	}
 
@@ -125,64 +153,41 @@ static char n64Update(void)
 	caps[1] = gcn64_protocol_getByte(8);
 	caps[2] = gcn64_protocol_getByte(16);
 
-	/* Detect when a pack becomes present and schedule initialisation when it happens. */
-	if ((caps[2] & 0x01) && (n64_rumble_state == RSTATE_UNAVAILABLE)) {
-		n64_rumble_state = RSTATE_INIT;
-	}
-
 	/* Detect when a pack is removed. */
 	if (!(caps[2] & 0x01) || (caps[2] & 0x02) ) {
-		n64_rumble_state = RSTATE_UNAVAILABLE;
+		pak_type = N64_PAK_TYPE_NONE;
+		pak_probes = 0;
+	}
+	/* Identify a new pack. Attempts failing because of
+	 * transfer errors are retried at the next polls. */
+	else if (pak_type == N64_PAK_TYPE_NONE) {
+		if (pak_probes < PAK_MAX_PROBES) {
+			pak_probes++;
+			pak_type = n64_pak_identify(tmpdata);
+		} else if (initRumble() == N64_PAK_OK) {
+			pak_type = N64_PAK_TYPE_RUMBLE;
+		}
+		n64_rumble_state = RSTATE_TURNOFF;
 	}
 #ifdef BUTTON_A_RUMBLE_TEST
 	must_rumble = force_rumble;
 #endif
 
-	switch (n64_rumble_state)
-	{
-		case RSTATE_INIT:
-			/* Retry until the controller answers with a full byte. */
-			if (initRumble() != 0) {
-				if (initRumble() != 0) {
-					n64_rumble_state = RSTATE_UNAVAILABLE;
-				}
-				break;
-			}
-
-			if (must_rumble) {
-				controlRumble(1);
-				n64_rumble_state = RSTATE_ON;
+	/* No expansion traffic at all for the other pak types. The write
+	 * carries the final requested state. RSTATE_TURNON and RSTATE_TURNOFF
+	 * (initial state, or failed write) are retried. */
+	if (pak_type == N64_PAK_TYPE_RUMBLE && rumbleWriteAllowed()) {
+		if (n64_rumble_state != (must_rumble ? RSTATE_ON : RSTATE_OFF)) {
+			res = controlRumble(must_rumble);
+			if (res == N64_PAK_OK) {
+				n64_rumble_state = must_rumble ? RSTATE_ON : RSTATE_OFF;
 			} else {
-				controlRumble(0);
-				n64_rumble_state = RSTATE_OFF;
-			}
-			break;
-
-		case RSTATE_TURNON:
-			if (0 == controlRumble(1)) {
-				n64_rumble_state = RSTATE_ON;
-			}
-			break;
-
-		case RSTATE_TURNOFF:
-			if (0 == controlRumble(0)) {
-				n64_rumble_state = RSTATE_OFF;
-			}
-			break;
-
-		case RSTATE_ON:
-			if (!must_rumble) {
-				 controlRumble(0);
-				 n64_rumble_state = RSTATE_OFF;
-			}
-			break;
-
-		case RSTATE_OFF:
-			if (must_rumble) {
-				 controlRumble(1);
-				n64_rumble_state = RSTATE_ON;
+				n64_rumble_state = must_rumble ? RSTATE_TURNON : RSTATE_TURNOFF;
+				if (res == N64_PAK_ERR_ABSENT) {
+					pak_type = N64_PAK_TYPE_NONE;
+				}
 			}
-			break;
+		}
 	}
 
 	tmpdata[0] = N64_GET_STATUS;
@@ -226,22 +231,16 @@ static char n64Update(void)
 	}
 #endif
 
-	// Remap buttons as they always were by this
-	// adapter. Might change in v3 when a N64
-	// specific report descriptor will be used.
-	//
-	rb1 = rb2 = 0;
-	for (i=0; i<4; i++) // A B Z START
-		rb1 |= (btns1 & (0x80 >> i)) ? (0x01<<i) : 0;
-	for (i=0; i<4; i++) // C-UP C-DOWN C-LEFT C-RIGHT
-		rb1 |= btns2 & (0x08 >> i) ? (0x10<<i) : 0;
-	for (i=0; i<2; i++) // L R
-		rb2 |= btns2 & (0x20 >> i) ? (0x01<<i) : 0;
-	for (i=0; i<4; i++) // Up down left right
-		rb2 |= btns1 & (0x08 >> i) ? (0x04<<i) : 0;
+	// Remap buttons (see remap.c). The default table
+	// maps them as they always were by this adapter.
+	// Report buttons 15 and 16 do not exist in the N64 report.
+	buttons = remap_buttons(btns1, btns2);
+	rb1 = buttons;
+	rb2 = (buttons >> 8) & ((1 << (N64_NUM_BUTTONS - 8)) - 1);
 
+	// The default remap table inverts Y
 	x = (x ^ 0x80) - 1;
-	y = ((y ^ 0x80) ) ^ 0xFF;
+	y = y ^ 0x80;
 
 	// The following helps a cheap TTX controller
 	// which uses the full 8 bit range instead
@@ -252,23 +251,30 @@ static char n64Update(void)
 	if (x == 0xFF)
 		x = 0;
 
-	// analog joystick
-	last_built_report[0] = 1;
-	last_built_report[1] = x;
-	last_built_report[2] = y;
+	// analog joystick. Only X and Y are in the report.
+	axes[0] = x;
+	axes[1] = y;
+	memset(axes+2, 0x7f, GCN64_NUM_AXES-2);
+	remap_axes(axes, mapped);
 
-	last_built_report[3] = 0x7f;
-	last_built_report[4] = 0x7f;
-	last_built_report[5] = 0x7f;
-	last_built_report[6] = 0x7f;
+	last_built_report[0] = 1;
+	memcpy(last_built_report+1, mapped, N64_NUM_AXES);
 
 	// buttons
-	last_built_report[7] = rb1;
-	last_built_report[8] = rb2;
+	if (g_config.flags & CFG_FLAG_COALESCE_BUTTONS) {
+		latched_buttons[0] |= rb1;
+		latched_buttons[1] |= rb2;
+	}
+	last_built_report[3] = rb1 | latched_buttons[0];
+	last_built_report[4] = rb2 | latched_buttons[1];
+
+	axis_filter(last_built_report+1, last_sent_report+1, N64_NUM_AXES, N64_AXIS_CENTER, N64_AXIS_RANGE);
 
 	return 0;
 }
 
+PROF_UPDATE_WRAPPER(n64Update, PROF_N64_UPDATE)
+
 static char n64Probe(void)
 {
 	int count;
@@ -285,11 +291,13 @@ static char n64Probe(void)
 	 * Bit 1 tells is if there was something connected that has been removed.
 	 */
 
-	n64_rumble_state = RSTATE_UNAVAILABLE;
+	pak_type = N64_PAK_TYPE_NONE;
+	pak_probes = 0;
 
 	for (i=0; i<15; i++)
 	{
 		usbPoll(); // must be called at each 50ms or less
+		stats_usbPolled();
 		_delay_ms(30);
 
 		tmp = N64_GET_CAPABILITIES;
@@ -304,16 +312,17 @@ static char n64Probe(void)
 
 static char n64Changed(int id)
 {
-	return memcmp(last_built_report, last_sent_report, GCN64_REPORT_SIZE);
+	return memcmp(last_built_report, last_sent_report, N64_REPORT_SIZE);
 }
 
 static int n64BuildReport(unsigned char *reportBuffer, int id)
 {
 	if (reportBuffer)
-		memcpy(reportBuffer, last_built_report, GCN64_REPORT_SIZE);
+		memcpy(reportBuffer, last_built_report, N64_REPORT_SIZE);
 
-	memcpy(	last_sent_report, last_built_report, GCN64_REPORT_SIZE);
-	return GCN64_REPORT_SIZE;
+	memcpy(	last_sent_report, last_built_report, N64_REPORT_SIZE);
+	latched_buttons[0] = latched_buttons[1] = 0;
+	return N64_REPORT_SIZE;
 }
 
 static void n64SetVibration(int value)
@@ -321,9 +330,9 @@ static void n64SetVibration(int value)
 	must_rumble = value;
 }
 
-static Gamepad N64Gamepad = {
+static const Gamepad N64Gamepad PROGMEM = {
 	.init					= n64Init,
-	.update					= n64Update,
+	.update					= PROF_UPDATE(n64Update),
 	.changed				= n64Changed,
 	.buildReport			= n64BuildReport,
 	.probe					= n64Probe,
@@ -333,7 +342,10 @@ static Gamepad N64Gamepad = {
 
 Gamepad *n64GetGamepad(void)
 {
-	N64Gamepad.reportDescriptor = (void*)gcn64_usbHidReportDescriptor;
-	N64Gamepad.reportDescriptorSize = getUsbHidReportDescriptor_size();
-	return &N64Gamepad;
+	memcpy_P(&g_gamepad, &N64Gamepad, sizeof(Gamepad));
+	g_gamepad.reportDescriptor = (void*)n64_usbHidReportDescriptor;
+	g_gamepad.reportDescriptorSize = getN64UsbHidReportDescriptor_size();
+	g_gamepad.reportDescriptorTail = (void*)gcn64_pidReportDescriptor;
+	g_gamepad.reportDescriptorTailSize = getPidReportDescriptor_size();
+	return &g_gamepad;
 }
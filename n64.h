@@ -1,4 +1,8 @@
+#ifndef _n64_h__
+#define _n64_h__
+
 #include "gamepad.h"
 
 Gamepad *n64GetGamepad(void);
 
+#endif // _n64_h__
@@ -0,0 +1,197 @@
+/*	gc_n64_usb : Gamecube or N64 controller to USB firmware
+	Copyright (C) 2007-2016  Raphael Assenat <raph@raphnet.net>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <string.h>
+#include "gamepad.h"
+#include "n64_mouse.h"
+#include "gcn64_protocol.h"
+
+/*********** prototypes *************/
+static void n64MouseInit(void);
+static char n64MouseUpdate(void);
+static char n64MouseChanged(int id);
+
+#define N64_MOUSE_REPORT_SIZE	HID_BOOT_MOUSE_REPORT_SIZE
+
+#define N64_MOUSE_BTN_A		0x80 // Left
+#define N64_MOUSE_BTN_B		0x40 // Right
+
+/* Buttons from the most recent reply */
+static unsigned char cur_buttons;
+
+/* Buttons in the last report sent to the host */
+static unsigned char sent_buttons;
+
+/* The mouse replies with the motion since the previous poll. Polls
+ * happen more often than the host fetches reports, so the motion is
+ * accumulated here until sent. What does not fit in a report
+ * (+/-127) is kept for the next one. */
+static int acc_x, acc_y;
+
+/* Standard boot protocol mouse report (HID 1.11 Appendix B.2)
+ *
+ * [0] Buttons (bit 0: Left, bit 1: Right)
+ * [1] X displacement
+ * [2] Y displacement
+ */
+static const unsigned char n64MouseReport[] PROGMEM = {
+	0x05, 0x01, // Usage Page (Generic Desktop)
+	0x09, 0x02, // Usage (Mouse)
+	0xA1, 0x01, // Collection (Application)
+	0x09, 0x01, //   Usage (Pointer)
+	0xA1, 0x00, //   Collection (Physical)
+		0x05, 0x09, // Usage Page (Button)
+		0x19, 0x01, // Usage Minimum (1)
+		0x29, 0x02, // Usage Maximum (2)
+		0x15, 0x00, // Logical Minimum (0)
+		0x25, 0x01, // Logical Maximum (1)
+		0x95, 0x02, // Report Count (2)
+		0x75, 0x01, // Report Size (1)
+		0x81, 0x02, // Input (Data, Variable, Absolute)
+
+			// Padding
+		0x95, 0x01, // Report Count (1)
+		0x75, 0x06, // Report Size (6)
+		0x81, 0x01, // Input (Constant)
+
+		0x05, 0x01, // Usage Page (Generic Desktop)
+		0x09, 0x30, // Usage (X)
+		0x09, 0x31, // Usage (Y)
+		0x15, 0x81, // Logical Minimum (-127)
+		0x25, 0x7F, // Logical Maximum (127)
+		0x75, 0x08, // Report Size (8)
+		0x95, 0x02, // Report Count (2)
+		0x81, 0x06, // Input (Data, Variable, Relative)
+	0xC0,       //   End Collection
+	0xC0,       // End Collection
+};
+
+static void n64MouseInit(void)
+{
+	acc_x = acc_y = 0;
+	cur_buttons = sent_buttons = 0;
+	n64MouseUpdate();
+}
+
+static void accumulate(int *acc, int delta)
+{
+	/* Keep the sum within what a few reports can drain */
+	if (delta > 0 && *acc > 0x3fff)
+		return;
+	if (delta < 0 && *acc < -0x3fff)
+		return;
+	*acc += delta;
+}
+
+static char n64MouseUpdate(void)
+{
+	unsigned char tmpdata[4];
+	unsigned char count;
+
+	tmpdata[0] = N64_GET_STATUS;
+	count = gcn64_transaction(tmpdata, 1);
+	if (count != N64_GET_STATUS_REPLY_LENGTH) {
+		return 1; // failure
+	}
+
+	/*
+		Bit	Function
+		0	A
+		1	B
+		2-15	Other buttons (unused)
+		16-23	X displacement (signed, right is positive)
+		24-31	Y displacement (signed, up is positive)
+	 */
+	gcn64_protocol_getBytes(0, 4, tmpdata);
+
+	cur_buttons = 0;
+	if (tmpdata[0] & N64_MOUSE_BTN_A)
+		cur_buttons |= 0x01;
+	if (tmpdata[0] & N64_MOUSE_BTN_B)
+		cur_buttons |= 0x02;
+
+	// HID: down is positive. Negated as an int so -128 does not wrap.
+	accumulate(&acc_x, (signed char)tmpdata[2]);
+	accumulate(&acc_y, -(int)(signed char)tmpdata[3]);
+
+	return 0; // success
+}
+
+static char n64MouseProbe(void)
+{
+	if (0 == n64MouseUpdate())
+		return 1;
+
+	return 0;
+}
+
+static char n64MouseChanged(int id)
+{
+	return acc_x || acc_y || cur_buttons != sent_buttons;
+}
+
+static signed char drain(int *acc)
+{
+	int d = *acc;
+
+	if (d > 127)
+		d = 127;
+	if (d < -127)
+		d = -127;
+	*acc -= d;
+
+	return d;
+}
+
+static int n64MouseBuildReport(unsigned char *reportBuffer, int id)
+{
+	unsigned char dx, dy;
+
+	/* Called with a NULL buffer to mark the current state as sent. The
+	 * motion is drained either way, or it would be reported twice. */
+	dx = drain(&acc_x);
+	dy = drain(&acc_y);
+
+	if (reportBuffer != NULL) {
+		reportBuffer[0] = cur_buttons;
+		reportBuffer[1] = dx;
+		reportBuffer[2] = dy;
+	}
+
+	sent_buttons = cur_buttons;
+	return N64_MOUSE_REPORT_SIZE;
+}
+
+static const Gamepad N64MouseGamepad PROGMEM = {
+	.num_reports			= 1,
+	.init					= n64MouseInit,
+	.update					= n64MouseUpdate,
+	.changed				= n64MouseChanged,
+	.buildReport			= n64MouseBuildReport,
+	.probe					= n64MouseProbe,
+	.bootProtocol			= HID_BOOT_PROTOCOL_MOUSE,
+};
+
+Gamepad *n64_mouse_getGamepad(void)
+{
+	memcpy_P(&g_gamepad, &N64MouseGamepad, sizeof(Gamepad));
+	g_gamepad.reportDescriptor = (void*)n64MouseReport;
+	g_gamepad.reportDescriptorSize = sizeof(n64MouseReport);
+	return &g_gamepad;
+}
+
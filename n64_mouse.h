@@ -0,0 +1,8 @@
+#ifndef _n64_mouse_h__
+#define _n64_mouse_h__
+
+#include "gamepad.h"
+
+Gamepad *n64_mouse_getGamepad(void);
+
+#endif // _n64_mouse_h__
@@ -0,0 +1,284 @@
+/*	gc_n64_usb : Gamecube or N64 controller to USB firmware
+	Copyright (C) 2007-2016  Raphael Assenat <raph@raphnet.net>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <avr/sleep.h>
+#include <avr/wdt.h>
+#include <util/delay.h>
+#include <string.h>
+#include "n64_pak.h"
+#include "gcn64_protocol.h"
+
+// Attempts for each block before giving up
+#define PAK_RETRIES	3
+
+/* Address CRC: Each address bit (from bit 5) toggles a set of CRC bits */
+static const unsigned char addr_crc_table[11] PROGMEM = {
+	0x15, 0x1F, 0x0B, 0x16, 0x19, 0x07, 0x0E, 0x1C, 0x0D, 0x1A, 0x01
+};
+
+unsigned short n64_pak_address(unsigned short addr)
+{
+	unsigned char i, crc = 0;
+
+	addr &= ~0x1F;
+	for (i=0; i<11; i++) {
+		if (addr & (0x20 << i)) {
+			crc ^= pgm_read_byte(&addr_crc_table[i]);
+		}
+	}
+
+	return addr | crc;
+}
+
+/* Data CRC: polynomial 0x85, over the 32 bytes followed by 8 zero bits */
+unsigned char n64_pak_dataCrc(const unsigned char *data)
+{
+	unsigned char i, bit, msb, crc = 0;
+
+	for (i=0; i<=N64_PAK_BLOCK_SIZE; i++) {
+		for (bit=0x80; bit; bit >>= 1) {
+			msb = crc & 0x80;
+			crc <<= 1;
+			if (i < N64_PAK_BLOCK_SIZE && (data[i] & bit))
+				crc |= 1;
+			if (msb)
+				crc ^= 0x85;
+		}
+	}
+
+	return crc;
+}
+
+/* The controller computes the CRC of the data it received or sends it, and
+ * compares it with the one computed by the pak. Without a pak, the CRC is
+ * returned inverted. */
+static char checkCrc(unsigned char reply, unsigned char crc)
+{
+	if (reply == crc)
+		return N64_PAK_OK;
+	if (reply == (crc ^ 0xff))
+		return N64_PAK_ERR_ABSENT;
+	return N64_PAK_ERR_CORRUPTED;
+}
+
+/* Block transfers take more than a millisecond, longer than the time
+ * between two USB interrupts. Like sleepsync() in main.c, start right
+ * after one so the transfer is less likely to be disturbed. Interrupts
+ * stay enabled for V-USB, and a disturbed transfer fails its CRC check
+ * and is retried.
+ *
+ * During startup, interrupts are not enabled yet. Sleeping would never
+ * end, and there is nothing to synchronize with anyway. */
+static int pakTransaction(unsigned char *data, int len)
+{
+	if (SREG & 0x80) {
+		wdt_disable();
+		sleep_enable();
+		sleep_cpu();
+		sleep_disable();
+		_delay_us(100);
+		wdt_enable(WDTO_2S);
+	}
+
+	return gcn64_transactionBits(data, len);
+}
+
+char n64_pak_readBlock(unsigned short addr, unsigned char *dst)
+{
+	unsigned char cmd[3];
+	unsigned char tries, crc;
+	int count;
+	char res = N64_PAK_ERR_TRANSFER;
+
+	addr = n64_pak_address(addr);
+
+	for (tries=0; tries<PAK_RETRIES; tries++) {
+		cmd[0] = N64_EXPANSION_READ;
+		cmd[1] = addr >> 8;
+		cmd[2] = addr;
+
+		count = pakTransaction(cmd, 3);
+		if (count != N64_EXPANSION_READ_REPLY_LENGTH) {
+			res = N64_PAK_ERR_TRANSFER;
+			continue;
+		}
+
+		gcn64_protocol_getBytes(0, N64_PAK_BLOCK_SIZE, dst);
+		crc = gcn64_protocol_getByte(N64_PAK_BLOCK_SIZE * 8);
+		res = checkCrc(crc, n64_pak_dataCrc(dst));
+		if (res != N64_PAK_ERR_CORRUPTED)
+			break; // Done, or no point in trying again
+	}
+
+	return res;
+}
+
+char n64_pak_writeBlock(unsigned short addr, unsigned char *buf)
+{
+	unsigned char tries, crc;
+	int count;
+	char res = N64_PAK_ERR_TRANSFER;
+
+	addr = n64_pak_address(addr);
+	crc = n64_pak_dataCrc(buf + N64_PAK_WRITE_HEADER);
+
+	buf[0] = N64_EXPANSION_WRITE;
+	buf[1] = addr >> 8;
+	buf[2] = addr;
+
+	for (tries=0; tries<PAK_RETRIES; tries++) {
+		count = pakTransaction(buf, N64_PAK_WRITE_HEADER + N64_PAK_BLOCK_SIZE);
+		if (count != N64_EXPANSION_WRITE_REPLY_LENGTH) {
+			res = N64_PAK_ERR_TRANSFER;
+			continue;
+		}
+
+		res = checkCrc(gcn64_protocol_getByte(0), crc);
+		if (res != N64_PAK_ERR_CORRUPTED)
+			break; // Done, or no point in trying again
+	}
+
+	return res;
+}
+
+/* Fill the block at 0x8000 with value and read it back. */
+static char probe(unsigned char *buf, unsigned char value, unsigned char *readback)
+{
+	char res;
+
+	memset(buf + N64_PAK_WRITE_HEADER, value, N64_PAK_BLOCK_SIZE);
+	res = n64_pak_writeBlock(0x8000, buf);
+	if (res)
+		return res;
+
+	res = n64_pak_readBlock(0x8000, buf);
+	*readback = buf[N64_PAK_BLOCK_SIZE - 1];
+
+	return res;
+}
+
+/* The same sequence as the N64 libraries. Memory at 0x8000 is
+ * only found in controller paks, and is tested before anything
+ * else is written. 0x80 enables rumble paks, 0x84 powers transfer
+ * paks on, and 0xFE resets both.
+ *
+ * The sequence depends on reading back what was written. Nothing is
+ * written unless a first read of 0x8000 passes the CRC check. */
+unsigned char n64_pak_identify(unsigned char *buf)
+{
+	unsigned char readback;
+
+	if (n64_pak_readBlock(0x8000, buf))
+		return N64_PAK_TYPE_NONE;
+
+	if (probe(buf, 0xFE, &readback))
+		return N64_PAK_TYPE_NONE;
+	if (readback == 0xFE)
+		return N64_PAK_TYPE_MEMORY;
+
+	if (probe(buf, 0x80, &readback))
+		return N64_PAK_TYPE_NONE;
+	if (readback == 0x80)
+		return N64_PAK_TYPE_RUMBLE;
+
+	if (probe(buf, 0x84, &readback))
+		return N64_PAK_TYPE_NONE;
+	if (readback == 0x84) {
+		probe(buf, 0xFE, &readback);
+		return N64_PAK_TYPE_TRANSFER;
+	}
+
+	return N64_PAK_TYPE_UNKNOWN;
+}
+
+/* Bank currently selected in the transfer pak. 0xff: Unknown */
+static unsigned char tpak_bank = 0xff;
+
+/* Fill a register with value. */
+static char tpakWriteReg(unsigned short addr, unsigned char value)
+{
+	unsigned char buf[N64_PAK_WRITE_HEADER + N64_PAK_BLOCK_SIZE];
+
+	memset(buf + N64_PAK_WRITE_HEADER, value, N64_PAK_BLOCK_SIZE);
+	return n64_pak_writeBlock(addr, buf);
+}
+
+static char tpakSelectBank(unsigned short gb_addr)
+{
+	unsigned char bank = gb_addr / N64_TPAK_WINDOW_SIZE;
+	char res;
+
+	if (bank == tpak_bank)
+		return N64_PAK_OK;
+
+	res = tpakWriteReg(N64_TPAK_BANK, bank);
+	tpak_bank = res ? 0xff : bank;
+
+	return res;
+}
+
+char n64_tpak_enable(unsigned char on, unsigned char *status)
+{
+	unsigned char buf[N64_PAK_BLOCK_SIZE];
+	char res;
+
+	tpak_bank = 0xff;
+
+	res = tpakWriteReg(N64_TPAK_POWER, on ? 0x84 : 0xFE);
+	if (res || !on)
+		return res;
+
+	// Only a transfer pak keeps 0x84 there. Also proves reading works
+	// before the cartridge is accessed.
+	res = n64_pak_readBlock(N64_TPAK_POWER, buf);
+	if (res)
+		return res;
+	if (buf[0] != 0x84)
+		return N64_PAK_ERR_NOT_TPAK;
+
+	res = tpakWriteReg(N64_TPAK_STATUS, 0x01);
+	if (res)
+		return res;
+
+	res = n64_pak_readBlock(N64_TPAK_STATUS, buf);
+	*status = buf[0];
+
+	return res;
+}
+
+char n64_tpak_readBlock(unsigned short gb_addr, unsigned char *dst)
+{
+	char res;
+
+	res = tpakSelectBank(gb_addr);
+	if (res)
+		return res;
+
+	return n64_pak_readBlock(N64_TPAK_WINDOW + gb_addr % N64_TPAK_WINDOW_SIZE, dst);
+}
+
+char n64_tpak_writeBlock(unsigned short gb_addr, unsigned char *buf)
+{
+	char res;
+
+	res = tpakSelectBank(gb_addr);
+	if (res)
+		return res;
+
+	return n64_pak_writeBlock(N64_TPAK_WINDOW + gb_addr % N64_TPAK_WINDOW_SIZE, buf);
+}
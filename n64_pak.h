@@ -0,0 +1,66 @@
+#ifndef _n64_pak_h__
+#define _n64_pak_h__
+
+/* N64 expansion port (Controller Pak, Rumble Pak, ...) access */
+
+#define N64_PAK_BLOCK_SIZE		32
+#define N64_PAK_SIZE			0x8000 // Controller Pak
+
+/* Bytes before the data in the buffer passed to n64_pak_writeBlock() */
+#define N64_PAK_WRITE_HEADER	3
+
+/* Return values */
+#define N64_PAK_OK				0
+#define N64_PAK_ERR_TRANSFER	1 // No reply, or not the expected length
+#define N64_PAK_ERR_ABSENT		2 // The controller reports no pak (inverted data CRC)
+#define N64_PAK_ERR_CORRUPTED	3 // Data CRC mismatch. Bad contact with the pak?
+#define N64_PAK_ERR_NOT_TPAK	4 // n64_tpak_enable(): Not a transfer pak
+
+/* Pak types */
+#define N64_PAK_TYPE_NONE		0 // Nothing, or not identified yet
+#define N64_PAK_TYPE_RUMBLE		1
+#define N64_PAK_TYPE_MEMORY		2 // Controller Pak
+#define N64_PAK_TYPE_TRANSFER	3
+#define N64_PAK_TYPE_UNKNOWN	4
+
+/* Returns addr with the address CRC in the 5 lower bits */
+unsigned short n64_pak_address(unsigned short addr);
+unsigned char n64_pak_dataCrc(const unsigned char *data);
+
+/* Read a 32 bytes block at addr (a multiple of 32) into dst. */
+char n64_pak_readBlock(unsigned short addr, unsigned char *dst);
+
+/* Write a 32 bytes block at addr (a multiple of 32). The data starts at
+ * buf + N64_PAK_WRITE_HEADER. The bytes before are used for the command. */
+char n64_pak_writeBlock(unsigned short addr, unsigned char *buf);
+
+/* Find out what kind of pak is connected. buf is a scratch buffer of
+ * N64_PAK_WRITE_HEADER + N64_PAK_BLOCK_SIZE bytes. A rumble pak is left
+ * initialized, a transfer pak is left powered off.
+ * Returns N64_PAK_TYPE_NONE on transfer errors. Nothing is written
+ * to the pak when reading fails. */
+unsigned char n64_pak_identify(unsigned char *buf);
+
+/* Transfer Pak (Game Boy cartridge adapter). The cartridge address space
+ * is seen through a 16K window at 0xC000. The bank register selects which
+ * quarter of the cartridge address space appears there. */
+#define N64_TPAK_POWER			0x8000 // Write 0x84: On, 0xFE: Off
+#define N64_TPAK_BANK			0xA000
+#define N64_TPAK_STATUS			0xB000 // Write 0x01: Enable cartridge access
+#define N64_TPAK_WINDOW			0xC000
+#define N64_TPAK_WINDOW_SIZE	0x4000
+
+/* Power the transfer pak on (and enable cartridge access) or off. When
+ * on, the status register is returned in *status. Call after inserting a
+ * pak or a cartridge, before the functions below. */
+char n64_tpak_enable(unsigned char on, unsigned char *status);
+
+/* Read or write a 32 bytes block at a cartridge address (a multiple of
+ * 32). The bank register is written when needed. Cartridge bank
+ * switching (MBC registers) is done by writing to the cartridge like
+ * the Game Boy would. The buffer passed to n64_tpak_writeBlock() is as
+ * for n64_pak_writeBlock(). */
+char n64_tpak_readBlock(unsigned short gb_addr, unsigned char *dst);
+char n64_tpak_writeBlock(unsigned short gb_addr, unsigned char *buf);
+
+#endif // _n64_pak_h__
@@ -0,0 +1,224 @@
+/*	gc_n64_usb : Gamecube or N64 controller to USB firmware
+	Copyright (C) 2007-2016  Raphael Assenat <raph@raphnet.net>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <avr/pgmspace.h>
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+#include <string.h>
+#include "remap.h"
+#include "eeprom_map.h"
+
+/* Button and axis remapping
+ *
+ * A table per controller type says where each button and axis goes in
+ * the report. When a controller is initialized, the destination of
+ * each button is copied from its table. Lookup tables per group of buttons
+ * would be faster, but RAM is scarcer than the few hundred cycles saved.
+ */
+
+typedef struct {
+	RemapTable table;
+	unsigned char crc; // must be last
+} RemapRecord;
+
+#define eeprom_records	((RemapRecord *)EEPROM_REMAP_ADDR)
+EEPROM_CHECK_FITS(remap_fits, REMAP_NUM_TYPES * sizeof(RemapRecord) <= EEPROM_CONFIG_ADDR - EEPROM_REMAP_ADDR);
+
+#define N	REMAP_NONE
+#define INV	REMAP_AXIS_INVERT
+
+/* The mappings this adapter always used */
+static const RemapTable default_tables[REMAP_NUM_TYPES] PROGMEM = {
+	[REMAP_GAMECUBE] = {
+		// 0 0 0 Start Y X B A
+		// 1 L R Z Up Down Right Left
+		.buttons = { N, N, N, 0, 1, 2, 3, 4,
+					 N, 5, 6, 7, 8, 9, 10, 11 },
+		// Y axes inverted. Sliders decrease as pushed (v2.x behaviour)
+		.axes = { 0, 1|INV, 2, 3|INV, 4|INV, 5|INV },
+	},
+	[REMAP_N64] = {
+		// A B Z Start Up Down Left Right
+		// - - L R C-Up C-Down C-Left C-Right
+		.buttons = { 0, 1, 2, 3, 10, 11, 12, 13,
+					 N, N, 8, 9, 4, 5, 6, 7 },
+		// Y axis inverted
+		.axes = { 0, 1|INV, N, N, N, N },
+	},
+};
+
+#undef N
+#undef INV
+
+/* Report button of each button (or REMAP_NONE), most significant
+ * bit of the first byte first. */
+static unsigned char button_dst[REMAP_NUM_BUTTONS];
+static unsigned char axis_src[GCN64_NUM_AXES];
+static unsigned char axis_xor[GCN64_NUM_AXES];
+
+static unsigned char loaded_type = 0xff;
+
+/* EEPROM write buffer */
+static RemapRecord record;
+static unsigned char write_type;
+static unsigned char write_remaining;
+
+static unsigned char recordCrc(const RemapRecord *rec)
+{
+	const unsigned char *p = (const unsigned char *)rec;
+	unsigned char i, crc = 0;
+
+	for (i=0; i<sizeof(RemapRecord)-1; i++) {
+		crc = _crc_ibutton_update(crc, p[i]);
+	}
+
+	return crc;
+}
+
+static char isValidTable(const RemapTable *table)
+{
+	unsigned char i;
+
+	for (i=0; i<REMAP_NUM_BUTTONS; i++) {
+		if (table->buttons[i] >= REMAP_NUM_BUTTONS && table->buttons[i] != REMAP_NONE)
+			return 0;
+	}
+	for (i=0; i<GCN64_NUM_AXES; i++) {
+		unsigned char src = table->axes[i] & ~REMAP_AXIS_INVERT;
+		if (src >= GCN64_NUM_AXES && src != REMAP_NONE)
+			return 0;
+	}
+
+	return 1;
+}
+
+static void compile(const RemapTable *table)
+{
+	unsigned char bit;
+
+	memcpy(button_dst, table->buttons, REMAP_NUM_BUTTONS);
+
+	for (bit=0; bit<GCN64_NUM_AXES; bit++) {
+		axis_src[bit] = table->axes[bit] & ~REMAP_AXIS_INVERT;
+		axis_xor[bit] = (table->axes[bit] & REMAP_AXIS_INVERT) ? 0xff : 0x00;
+	}
+}
+
+void remap_get(unsigned char type, RemapTable *dst)
+{
+	RemapRecord rec;
+
+	if (type >= REMAP_NUM_TYPES)
+		type = REMAP_GAMECUBE;
+
+	if (write_remaining && write_type == type) {
+		memcpy(dst, &record.table, sizeof(RemapTable));
+		return;
+	}
+
+	eeprom_read_block(&rec, &eeprom_records[type], sizeof(RemapRecord));
+	if (rec.crc == recordCrc(&rec) && isValidTable(&rec.table)) {
+		memcpy(dst, &rec.table, sizeof(RemapTable));
+	} else {
+		memcpy_P(dst, &default_tables[type], sizeof(RemapTable));
+	}
+}
+
+void remap_load(unsigned char type)
+{
+	RemapTable table;
+
+	remap_get(type, &table);
+	compile(&table);
+	loaded_type = type;
+}
+
+char remap_set(unsigned char type, const RemapTable *table)
+{
+	if (type >= REMAP_NUM_TYPES)
+		return -1;
+	if (!isValidTable(table))
+		return -1;
+	// Still writing the table of the other controller type
+	if (write_remaining && write_type != type)
+		return -1;
+
+	// An interrupted write leaves an invalid record, so the
+	// default table gets used. Good enough.
+	memcpy(&record.table, table, sizeof(RemapTable));
+	record.crc = recordCrc(&record);
+	write_type = type;
+	write_remaining = sizeof(RemapRecord);
+
+	if (type == loaded_type)
+		compile(table);
+
+	return 0;
+}
+
+char remap_setDefault(unsigned char type)
+{
+	RemapTable table;
+
+	if (type >= REMAP_NUM_TYPES)
+		return -1;
+
+	memcpy_P(&table, &default_tables[type], sizeof(RemapTable));
+	return remap_set(type, &table);
+}
+
+unsigned short remap_buttons(unsigned char btns1, unsigned char btns2)
+{
+	unsigned short in = (btns1 << 8) | btns2;
+	unsigned short out = 0;
+	unsigned char i;
+
+	for (i=0; i<REMAP_NUM_BUTTONS; i++) {
+		// Validated by isValidTable(): Either REMAP_NONE or < 16
+		if ((in & 0x8000) && button_dst[i] != REMAP_NONE)
+			out |= 1 << button_dst[i];
+		in <<= 1;
+	}
+
+	return out;
+}
+
+void remap_axes(const unsigned char *in, unsigned char *out)
+{
+	unsigned char i;
+
+	for (i=0; i<GCN64_NUM_AXES; i++) {
+		if (axis_src[i] < GCN64_NUM_AXES) {
+			out[i] = in[axis_src[i]] ^ axis_xor[i];
+		} else {
+			out[i] = 0x7f ^ axis_xor[i];
+		}
+	}
+}
+
+/* Write one byte per call, not to hold usbPoll() back */
+void remap_doTasks(void)
+{
+	unsigned char ofs;
+
+	if (!write_remaining || !eeprom_is_ready())
+		return;
+
+	ofs = sizeof(RemapRecord) - write_remaining;
+	eeprom_update_byte((unsigned char *)&eeprom_records[write_type] + ofs,
+						((unsigned char *)&record)[ofs]);
+	write_remaining--;
+}
@@ -0,0 +1,65 @@
+/*	gc_n64_usb : Gamecube or N64 controller to USB firmware
+	Copyright (C) 2007-2016  Raphael Assenat <raph@raphnet.net>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef _remap_h__
+#define _remap_h__
+
+#include "reportdesc.h"
+
+/* Controller types, each with its own table */
+#define REMAP_GAMECUBE		0
+#define REMAP_N64			1
+#define REMAP_NUM_TYPES		2
+
+#define REMAP_NUM_BUTTONS	16
+
+/* Button entries: Report button (0-15) or REMAP_NONE.
+ * Axis entries: Controller axis (0-5) or REMAP_NONE (centered),
+ * optionally ORed with REMAP_AXIS_INVERT. */
+#define REMAP_NONE			0x7f
+#define REMAP_AXIS_INVERT	0x80
+
+/* Buttons are in the order they are received from the controller
+ * (first bit of the status reply first). Axes are in the order
+ * of the report: X, Y, Rx, Ry, Rz, Slider. */
+typedef struct {
+	unsigned char buttons[REMAP_NUM_BUTTONS];
+	unsigned char axes[GCN64_NUM_AXES];
+} RemapTable;
+
+/* Compile the table stored for a controller type (or the default one)
+ * for use by remap_buttons() and remap_axes(). */
+void remap_load(unsigned char type);
+
+/* Returns the stored or the default table for a controller type. */
+void remap_get(unsigned char type, RemapTable *dst);
+
+/* Store a new table and use it if this controller type is currently
+ * loaded. Returns 0 on success. */
+char remap_set(unsigned char type, const RemapTable *table);
+
+/* Store the default table for a controller type. */
+char remap_setDefault(unsigned char type);
+
+/* The first two bytes received from the controller in, the two
+ * report button bytes out (first byte in the low 8 bits). */
+unsigned short remap_buttons(unsigned char btns1, unsigned char btns2);
+
+void remap_axes(const unsigned char *in, unsigned char *out);
+
+void remap_doTasks(void);
+
+#endif // _remap_h__
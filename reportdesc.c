@@ -68,6 +68,11 @@ const char gcn64_usbHidReportDescriptor[] PROGMEM = {
 	0x81, 0x02,                    // INPUT 
 
     0xc0,               //  END COLLECTION                      
+};
+
+/* The force feedback part, shared by the joystick descriptors above
+ * and below. Sent right after them. Closes the application collection. */
+const char gcn64_pidReportDescriptor[] PROGMEM = {
 #if 0
 //???
    0x06,0x01,0xFF,   //    Usage Page Generic Desktop
@@ -652,8 +657,50 @@ const char gcn64_usbHidReportDescriptor[] PROGMEM = {
 
 };
 
+/* N64 controllers: 2 axes and 14 buttons in a single packet report */
+const char n64_usbHidReportDescriptor[] PROGMEM = {
+0x05,0x01,  //    Usage Page Generic Desktop
+0x09,0x05,  //    Usage Joystick
+0xA1,0x01,  //    Collection Application
+	0x85,0x01,						// Report ID 1
+	0x09,0x01,						// USAGE (Pointer)
+	0xA1,0x00,						// COLLECTION (phys)
+		0x05,0x01,					// USAGE_PAGE (Generic desktop)
+		0x75,0x08,					// REPORT_SIZE (8)
+		0x95,0x02,					// REPORT_COUNT (2)
+		0x15,0x00,					// LOGICAL_MINIMUM (0)
+		0x26,0xFF,0x00,				// LOGICAL_MAXIMUM (255)
+		0x35,0x00,					// PHYSICAL_MINIMUM (0)
+		0x46,0xFF,0x00,				// PHYSICAL_MAXIMUM (255)
+		0x09,0x30,					// USAGE (X)
+		0x09,0x31,					// USAGE (Y)
+		0x81,0x02,					// INPUT
+
+		0x05,0x09,					// USAGE_PAGE (Button)
+		0x15,0x00,					// LOGICAL_MINIMUM (0)
+		0x25,0x01,					// LOGICAL_MAXIMUM (1)
+		0x75,0x01,					// REPORT_SIZE (1)
+		0x95,N64_NUM_BUTTONS,		// REPORT_COUNT (14)
+		0x19,0x01,					// USAGE_MINIMUM (Button 1)
+		0x29,N64_NUM_BUTTONS,		// USAGE_MAXIMUM (Button 14)
+		0x81,0x02,					// INPUT
+		0x95,16-N64_NUM_BUTTONS,	// REPORT_COUNT (2)
+		0x81,0x03,					// INPUT (Constant, Variable)
+	0xC0,							// END COLLECTION
+};
+
 int getUsbHidReportDescriptor_size(void)
 {
 	return sizeof(gcn64_usbHidReportDescriptor);
 }
 
+int getN64UsbHidReportDescriptor_size(void)
+{
+	return sizeof(n64_usbHidReportDescriptor);
+}
+
+int getPidReportDescriptor_size(void)
+{
+	return sizeof(gcn64_pidReportDescriptor);
+}
+
@@ -4,9 +4,19 @@
 #include <avr/pgmspace.h>
 
 #define GCN64_REPORT_SIZE	9
+#define GCN64_NUM_AXES		6 // X, Y, Rx, Ry, Rz, Slider
 
+#define N64_REPORT_SIZE		5
+#define N64_NUM_AXES		2 // X, Y
+#define N64_NUM_BUTTONS		14
+
+/* The joystick descriptors must be followed by gcn64_pidReportDescriptor */
 extern const char gcn64_usbHidReportDescriptor[] PROGMEM;
+extern const char n64_usbHidReportDescriptor[] PROGMEM;
+extern const char gcn64_pidReportDescriptor[] PROGMEM;
 int getUsbHidReportDescriptor_size(void);
+int getN64UsbHidReportDescriptor_size(void);
+int getPidReportDescriptor_size(void);
 
 #endif // _reportdesc_h__
 
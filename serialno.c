@@ -0,0 +1,146 @@
+/*	gc_n64_usb : Gamecube or N64 controller to USB firmware
+	Copyright (C) 2007-2016  Raphael Assenat <raph@raphnet.net>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+#include "usbdrv.h"
+#include "serialno.h"
+#include "eeprom_map.h"
+
+/* Per-device USB serial number
+ *
+ * The serial number is stored in EEPROM. When none is found (first boot),
+ * a random one is generated. It can also be assigned by the host (see
+ * RQ_SET_SERIAL in vendor.h).
+ */
+#define eeprom_serial	((unsigned char *)EEPROM_SERIAL_ADDR)
+EEPROM_CHECK_FITS(serial_fits, SERIALNO_LENGTH <= EEPROM_REMAP_ADDR - EEPROM_SERIAL_ADDR);
+
+/* The string descriptor (in RAM). Returned by usbFunctionDescriptor() */
+int usbDescriptorStringSerialNumber[1 + SERIALNO_LENGTH];
+
+static unsigned char write_remaining;
+
+/* Digits and upper case letters only */
+static char isValidChar(unsigned char c)
+{
+	return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z');
+}
+
+static void buildDescriptor(const unsigned char *serial)
+{
+	unsigned char i;
+
+	usbDescriptorStringSerialNumber[0] = USB_STRING_DESCRIPTOR_HEADER(SERIALNO_LENGTH);
+	for (i=0; i<SERIALNO_LENGTH; i++) {
+		usbDescriptorStringSerialNumber[1+i] = serial[i];
+	}
+}
+
+/* There is no unique ID on these chips. Collect some randomness from the
+ * power-up state of unused SRAM and from the noise on ADC readings
+ * of the internal bandgap reference. */
+static unsigned long gatherEntropy(void)
+{
+	extern unsigned char __heap_start;
+	unsigned char *p;
+	unsigned short crc_a = 0xffff, crc_b = 0;
+	unsigned char i;
+
+	for (p = &__heap_start; p < (unsigned char *)SP - 16; p++) {
+		crc_a = _crc16_update(crc_a, *p);
+		crc_b = _crc_ccitt_update(crc_b, *p);
+	}
+
+	ADMUX = (1<<REFS0) | 0x0E; // AVcc reference, bandgap input
+	for (i=0; i<64; i++) {
+		ADCSRA = (1<<ADEN) | (1<<ADSC) | (1<<ADPS2) | (1<<ADPS1) | (1<<ADPS0);
+		while (ADCSRA & (1<<ADSC)) { }
+		crc_a = _crc16_update(crc_a, ADCL);
+		crc_b = _crc_ccitt_update(crc_b, ADCH ^ TCNT1);
+	}
+	ADCSRA = 0;
+
+	return ((unsigned long)crc_a << 16) | crc_b;
+}
+
+void serialno_init(void)
+{
+	unsigned char serial[SERIALNO_LENGTH];
+	unsigned long rnd;
+	unsigned char i;
+
+	eeprom_read_block(serial, eeprom_serial, SERIALNO_LENGTH);
+
+	for (i=0; i<SERIALNO_LENGTH; i++) {
+		if (!isValidChar(serial[i]))
+			break;
+	}
+
+	if (i != SERIALNO_LENGTH) {
+		rnd = gatherEntropy();
+		for (i=0; i<SERIALNO_LENGTH; i++) {
+			// Not from a string, which would be copied to RAM
+			serial[i] = (rnd & 0xf) < 10 ? '0' + (rnd & 0xf) : 'A' - 10 + (rnd & 0xf);
+			rnd >>= 4;
+		}
+		// Before USB is initialized, so it is fine to block here.
+		eeprom_update_block(serial, eeprom_serial, SERIALNO_LENGTH);
+	}
+
+	buildDescriptor(serial);
+}
+
+/* Used by the host to assign a serial number. The new number is in
+ * use from the next enumeration. Returns 0 on success. */
+char serialno_set(const unsigned char *serial)
+{
+	unsigned char i;
+
+	for (i=0; i<SERIALNO_LENGTH; i++) {
+		if (!isValidChar(serial[i]))
+			return -1;
+	}
+
+	buildDescriptor(serial);
+	write_remaining = SERIALNO_LENGTH;
+
+	return 0;
+}
+
+void serialno_get(unsigned char *dst)
+{
+	unsigned char i;
+
+	for (i=0; i<SERIALNO_LENGTH; i++) {
+		dst[i] = usbDescriptorStringSerialNumber[1+i];
+	}
+}
+
+/* Write one byte per call, not to hold usbPoll() back */
+void serialno_doTasks(void)
+{
+	unsigned char ofs;
+
+	if (!write_remaining || !eeprom_is_ready())
+		return;
+
+	ofs = SERIALNO_LENGTH - write_remaining;
+	eeprom_update_byte(eeprom_serial + ofs, usbDescriptorStringSerialNumber[1+ofs]);
+	write_remaining--;
+}
+
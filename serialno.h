@@ -0,0 +1,14 @@
+#ifndef _serialno_h__
+#define _serialno_h__
+
+#include "usbconfig.h"
+
+#define SERIALNO_LENGTH		USB_CFG_SERIAL_NUMBER_LENGTH
+
+void serialno_init(void);
+char serialno_set(const unsigned char *serial);
+void serialno_get(unsigned char *dst);
+void serialno_doTasks(void);
+
+#endif // _serialno_h__
+
@@ -0,0 +1,66 @@
+/*	gc_n64_usb : Gamecube or N64 controller to USB firmware
+	Copyright (C) 2007-2016  Raphael Assenat <raph@raphnet.net>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <avr/io.h>
+#include <stddef.h>
+#include <string.h>
+#include "stats.h"
+
+Stats g_stats;
+
+#ifdef WITH_PROFILING
+ProfCounter g_prof[PROF_NUM_COUNTERS];
+
+void prof_add(unsigned char id, unsigned short start)
+{
+	unsigned short t = TCNT1 - start;
+
+	if (g_prof[id].calls == 0xffff)
+		return; // Keep total / calls meaningful
+	g_prof[id].calls++;
+	g_prof[id].total += t;
+	if (t > g_prof[id].max)
+		g_prof[id].max = t;
+}
+#endif
+
+static unsigned short last_usbpoll;
+static unsigned char usbpoll_seen;
+
+void stats_usbPolled(void)
+{
+	unsigned short now = TCNT1;
+	unsigned short gap = now - last_usbpoll;
+
+	last_usbpoll = now;
+	if (!usbpoll_seen) {
+		usbpoll_seen = 1;
+		return;
+	}
+
+	if (gap > g_stats.usbpoll_gap_max)
+		g_stats.usbpoll_gap_max = gap;
+}
+
+void stats_reset(void)
+{
+	// Everything but reset_cause, which only changes at startup
+	memset(&g_stats, 0, offsetof(Stats, reset_cause));
+#ifdef WITH_PROFILING
+	memset(g_prof, 0, sizeof(g_prof));
+#endif
+}
+
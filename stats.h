@@ -0,0 +1,78 @@
+#ifndef _stats_h__
+#define _stats_h__
+
+/* Counters and timing statistics. Readable by the host through
+ * the vendor requests (see vendor.h).
+ *
+ * Durations are in Timer1 ticks (64 CPU cycles, 5.33us at 12MHz).
+ */
+typedef struct {
+	unsigned short polls; // Controller polls
+	unsigned short poll_errors; // Failed polls (no reply, wrong length or corrupted)
+	unsigned short reports; // Reports sent on the interrupt endpoint
+	unsigned short disconnects; // Controller losses
+	unsigned short poll_time_last; // Duration of the last poll
+	unsigned short poll_time_max; // Longest poll
+	unsigned short marginal_bits; // Bits close to the threshold (CFG_FLAG_ADAPTIVE_DECODE)
+	unsigned short link_glitches; // Recoveries after failed polls, without losing the controller
+	unsigned short detect_attempts; // Detection attempts without a controller
+	unsigned short usbpoll_gap_max; // Longest time between usbPoll() calls. Must stay below 50ms (9375).
+
+	/* Kept by stats_reset() (RQ_RESET_STATS). Must remain last. */
+	unsigned short reset_cause; // MCUSR at startup. 0x08 (WDRF): The watchdog fired.
+} Stats;
+
+extern Stats g_stats;
+
+void stats_reset(void);
+
+/* Call after each usbPoll(), to keep track of g_stats.usbpoll_gap_max.
+ * Timer1 wraps after 349ms, so longer gaps may be underestimated. */
+void stats_usbPolled(void);
+
+/* Execution time profiling of the input path, to judge changes objectively.
+ * Only compiled in with -DWITH_PROFILING (see the Makefiles). Otherwise, the
+ * macros below generate no code. Read with RQ_GET_PROFILE.
+ *
+ * Times are in Timer1 ticks. Short functions may take less than a tick,
+ * but they start at random points within a tick, so the average over many
+ * calls (total / calls) remains accurate. USB interrupts occurring during
+ * a measurement are included (see max).
+ */
+#define PROF_GC_UPDATE		0 // gamecubeUpdate() in gamecube.c
+#define PROF_N64_UPDATE		1 // n64Update()
+#define PROF_GC_KB_UPDATE	2 // gamecubeUpdate() in gc_kb.c
+#define PROF_GET_BYTES		3 // gcn64_protocol_getBytes()
+#define PROF_DECODE			4 // gcn64_decodeWorkbuf() or gcn64_decodeWorkbuf_adaptive()
+#define PROF_NUM_COUNTERS	5
+
+typedef struct {
+	unsigned long total; // Sum of all durations
+	unsigned short calls;
+	unsigned short max; // Longest duration
+} ProfCounter;
+
+#ifdef WITH_PROFILING
+#include <avr/io.h>
+
+extern ProfCounter g_prof[PROF_NUM_COUNTERS];
+
+void prof_add(unsigned char id, unsigned short start);
+
+#define PROF_START(t)		unsigned short t = TCNT1
+#define PROF_END(id, t)		prof_add(id, t)
+
+/* For Gamepad update functions: Defines a profiled version of func,
+ * to be used in the Gamepad structure through PROF_UPDATE(func). */
+#define PROF_UPDATE_WRAPPER(func, id)	\
+	static char func##Profiled(void) { PROF_START(t); char res = func(); PROF_END(id, t); return res; }
+#define PROF_UPDATE(func)	func##Profiled
+#else
+#define PROF_START(t)
+#define PROF_END(id, t)
+#define PROF_UPDATE_WRAPPER(func, id)
+#define PROF_UPDATE(func)	func
+#endif
+
+#endif // _stats_h__
+
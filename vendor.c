@@ -0,0 +1,352 @@
+/*	gc_n64_usb : Gamecube or N64 controller to USB firmware
+	Copyright (C) 2007-2016  Raphael Assenat <raph@raphnet.net>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <string.h>
+#include "vendor.h"
+#include "config.h"
+#include "stats.h"
+#include "serialno.h"
+#include "history.h"
+#include "remap.h"
+#include "n64_pak.h"
+
+static unsigned char cur_request;
+static unsigned char cur_value;
+
+/* Data stage state, for usbFunctionRead/usbFunctionWrite */
+static unsigned char *xfer_ptr;
+static usbMsgLen_t xfer_remaining;
+static usbMsgLen_t xfer_offset;
+static unsigned char xfer_in; // Non-zero for device to host requests
+
+static unsigned char version_info[3];
+
+/* Buffers for the requests that do not transfer
+ * data in place. Only one is used at a time. */
+static union {
+	Config config; // SET_CONFIG data, applied once complete
+	unsigned char serial[SERIALNO_LENGTH]; // SET_SERIAL and GET_SERIAL
+	RemapTable remap; // SET_REMAP and GET_REMAP
+	unsigned char pak[2][N64_PAK_BLOCK_SIZE]; // PAK_READ, TPAK_READ: The block being sent and the next one
+	unsigned char pak_write[N64_PAK_WRITE_HEADER + N64_PAK_BLOCK_SIZE]; // PAK_WRITE, TPAK_WRITE
+} buf;
+
+/* PAK_READ, PAK_WRITE, TPAK_READ and TPAK_WRITE */
+static unsigned short pak_addr; // Start address
+static usbMsgLen_t pak_loaded; // PAK_READ: Bytes read so far
+
+/* TPAK_POWER is done by vendor_doTasks(), TPAK_STATUS returns the result */
+static unsigned char tpak_power_pending;
+static unsigned char tpak_power_on;
+static unsigned char tpak_result[2] = { TPAK_RESULT_NONE, 0 }; // Result, status register
+
+static unsigned char pending_action = ACTION_NONE;
+static unsigned char pending_action_arg;
+
+/* in: The direction the request is for. A request sent with the other
+ * direction is not accepted. */
+static usbMsgLen_t startTransfer(void *ptr, usbMsgLen_t len, usbMsgLen_t max_len, char in)
+{
+	if (in != xfer_in)
+		return 0;
+	xfer_ptr = ptr;
+	xfer_offset = 0;
+	xfer_remaining = len < max_len ? len : max_len;
+	return USB_NO_MSG;
+}
+
+static char isValidPakRange(usbRequest_t *rq, unsigned long size)
+{
+	unsigned short addr = rq->wValue.word;
+	unsigned short len = rq->wLength.word;
+
+	if ((addr | len) % N64_PAK_BLOCK_SIZE)
+		return 0;
+	if (addr >= size || len > size - addr)
+		return 0;
+
+	return 1;
+}
+
+static char pakReadBlock(unsigned short addr, unsigned char *dst)
+{
+	if (cur_request == RQ_TPAK_READ)
+		return n64_tpak_readBlock(addr, dst);
+	return n64_pak_readBlock(addr, dst);
+}
+
+static char pakWriteBlock(unsigned short addr, unsigned char *buf)
+{
+	if (cur_request == RQ_TPAK_WRITE)
+		return n64_tpak_writeBlock(addr, buf);
+	return n64_pak_writeBlock(addr, buf);
+}
+
+/* Read the next block, if it is needed and a buffer is free. Blocks
+ * alternate between the two buffers, so the next one can be read while
+ * the current one is being sent. */
+static char pakReadAhead(void)
+{
+	usbMsgLen_t sending = xfer_offset - (xfer_offset % N64_PAK_BLOCK_SIZE);
+
+	if (pak_loaded >= xfer_offset + xfer_remaining)
+		return 0; // Everything was read
+	if (pak_loaded >= sending + 2 * N64_PAK_BLOCK_SIZE)
+		return 0; // No free buffer
+
+	if (pakReadBlock(pak_addr + pak_loaded,
+					buf.pak[(pak_loaded / N64_PAK_BLOCK_SIZE) & 1])) {
+		return -1;
+	}
+	pak_loaded += N64_PAK_BLOCK_SIZE;
+
+	return 0;
+}
+
+usbMsgLen_t vendor_setup(usbRequest_t *rq, unsigned char n64_pad)
+{
+	cur_request = rq->bRequest;
+	cur_value = rq->wValue.bytes[0];
+	xfer_remaining = 0;
+	xfer_in = (rq->bmRequestType & USBRQ_DIR_MASK) == USBRQ_DIR_DEVICE_TO_HOST;
+	history_freeze(0);
+
+	if (rq->bRequest == RQ_GET_VERSION) {
+		version_info[0] = VENDOR_PROTOCOL_VERSION;
+		version_info[1] = sizeof(Config);
+		version_info[2] = sizeof(Stats);
+		return startTransfer(version_info, sizeof(version_info), rq->wLength.word, 1);
+	}
+
+	if (rq->wIndex.word != VENDOR_PROTOCOL_VERSION)
+		return 0;
+
+	switch (rq->bRequest)
+	{
+		case RQ_GET_CONFIG:
+			return startTransfer(&g_config, sizeof(Config), rq->wLength.word, 1);
+
+		case RQ_SET_CONFIG:
+			if (rq->wLength.word != sizeof(Config))
+				return 0;
+			return startTransfer(&buf.config, sizeof(Config), sizeof(Config), 0);
+
+		case RQ_GET_STATS:
+			return startTransfer(&g_stats, sizeof(Stats), rq->wLength.word, 1);
+
+#ifdef WITH_PROFILING
+		case RQ_GET_PROFILE:
+			return startTransfer(g_prof, sizeof(g_prof), rq->wLength.word, 1);
+#endif
+
+		case RQ_RESET_STATS:
+			stats_reset();
+			break;
+
+		case RQ_SAVE_CONFIG:
+			config_save();
+			break;
+
+		case RQ_DEFAULT_CONFIG:
+			config_setDefaults();
+			break;
+
+		case RQ_GET_SERIAL:
+			serialno_get(buf.serial);
+			return startTransfer(buf.serial, SERIALNO_LENGTH, rq->wLength.word, 1);
+
+		case RQ_SET_SERIAL:
+			if (rq->wLength.word != SERIALNO_LENGTH)
+				return 0;
+			return startTransfer(buf.serial, SERIALNO_LENGTH, SERIALNO_LENGTH, 0);
+
+		case RQ_GET_REMAP:
+			remap_get(cur_value, &buf.remap);
+			return startTransfer(&buf.remap, sizeof(RemapTable), rq->wLength.word, 1);
+
+		case RQ_SET_REMAP:
+			if (rq->wLength.word != sizeof(RemapTable))
+				return 0;
+			return startTransfer(&buf.remap, sizeof(RemapTable), sizeof(RemapTable), 0);
+
+		case RQ_DEFAULT_REMAP:
+			remap_setDefault(cur_value);
+			break;
+
+		case RQ_PAK_READ:
+		case RQ_TPAK_READ:
+			if (!n64_pad)
+				return 0;
+			if (!isValidPakRange(rq, rq->bRequest == RQ_PAK_READ ? N64_PAK_SIZE : 0x10000UL))
+				return 0;
+			pak_addr = rq->wValue.word;
+			pak_loaded = 0;
+			return startTransfer(NULL, rq->wLength.word, rq->wLength.word, 1);
+
+		case RQ_PAK_WRITE:
+		case RQ_TPAK_WRITE:
+			if (!n64_pad)
+				return 0;
+			if (!isValidPakRange(rq, rq->bRequest == RQ_PAK_WRITE ? N64_PAK_SIZE : 0x10000UL))
+				return 0;
+			pak_addr = rq->wValue.word;
+			return startTransfer(NULL, rq->wLength.word, rq->wLength.word, 0);
+
+		case RQ_TPAK_POWER:
+			if (!n64_pad)
+				return 0;
+			tpak_power_on = cur_value;
+			tpak_power_pending = 1;
+			tpak_result[0] = TPAK_RESULT_PENDING;
+			break;
+
+		case RQ_TPAK_STATUS:
+			return startTransfer(tpak_result, sizeof(tpak_result), rq->wLength.word, 1);
+
+		case RQ_GET_HISTORY:
+			if (!xfer_in)
+				return 0;
+			history_freeze(1);
+			return startTransfer(NULL, history_size(), rq->wLength.word, 1);
+
+		case RQ_ACTION:
+			pending_action = rq->wValue.bytes[0];
+			pending_action_arg = rq->wValue.bytes[1];
+			break;
+	}
+
+	return 0;
+}
+
+uchar vendor_read(uchar *data, uchar len)
+{
+	if (!xfer_in)
+		return 0; // Wrong direction. xfer_ptr may be NULL.
+
+	if (len > xfer_remaining)
+		len = xfer_remaining;
+
+	switch (cur_request)
+	{
+		case RQ_GET_HISTORY:
+			history_read(data, xfer_offset, len);
+			break;
+
+		case RQ_PAK_READ:
+		case RQ_TPAK_READ:
+			// Normally read ahead by vendor_doTasks()
+			if (pak_loaded <= xfer_offset && pakReadAhead()) {
+				xfer_remaining = 0;
+				return 0; // Read error. End the transfer early.
+			}
+			memcpy(data, buf.pak[(xfer_offset / N64_PAK_BLOCK_SIZE) & 1] +
+							(xfer_offset % N64_PAK_BLOCK_SIZE), len);
+			break;
+
+		default:
+			memcpy(data, xfer_ptr + xfer_offset, len);
+			break;
+	}
+	xfer_offset += len;
+	xfer_remaining -= len;
+
+	if (!xfer_remaining)
+		history_freeze(0);
+
+	return len;
+}
+
+uchar vendor_write(uchar *data, uchar len)
+{
+	if (!xfer_remaining || xfer_in)
+		return 0xff; // unexpected data, or wrong direction (xfer_ptr may be NULL)
+
+	if (len > xfer_remaining)
+		len = xfer_remaining;
+
+	if (cur_request == RQ_PAK_WRITE || cur_request == RQ_TPAK_WRITE) {
+		// Write each block once complete. The host
+		// gets NAKs while this is in progress.
+		memcpy(buf.pak_write + N64_PAK_WRITE_HEADER + (xfer_offset % N64_PAK_BLOCK_SIZE), data, len);
+		xfer_offset += len;
+		xfer_remaining -= len;
+
+		if (!(xfer_offset % N64_PAK_BLOCK_SIZE)) {
+			if (pakWriteBlock(pak_addr + xfer_offset - N64_PAK_BLOCK_SIZE, buf.pak_write)) {
+				xfer_remaining = 0;
+				return 0xff;
+			}
+		}
+
+		return xfer_remaining ? 0 : 1;
+	}
+
+	memcpy(xfer_ptr + xfer_offset, data, len);
+	xfer_offset += len;
+	xfer_remaining -= len;
+
+	if (xfer_remaining)
+		return 0; // more to come
+
+	switch (cur_request)
+	{
+		case RQ_SET_CONFIG:
+			if (config_set(&buf.config))
+				return 0xff;
+			break;
+
+		case RQ_SET_SERIAL:
+			if (serialno_set(buf.serial))
+				return 0xff;
+			break;
+
+		case RQ_SET_REMAP:
+			if (remap_set(cur_value, &buf.remap))
+				return 0xff;
+			break;
+	}
+
+	return 1;
+}
+
+void vendor_doTasks(void)
+{
+	if (tpak_power_pending) {
+		// Too long for usbFunctionSetup(): Several pak transactions
+		tpak_power_pending = 0;
+		tpak_result[1] = 0;
+		tpak_result[0] = n64_tpak_enable(tpak_power_on, &tpak_result[1]);
+	}
+
+	if ((cur_request == RQ_PAK_READ || cur_request == RQ_TPAK_READ) && xfer_remaining) {
+		pakReadAhead(); // On error, vendor_read() will try again
+	}
+}
+
+unsigned char vendor_getAction(unsigned char *arg)
+{
+	unsigned char action = pending_action;
+
+	*arg = pending_action_arg;
+	pending_action = ACTION_NONE;
+
+	return action;
+}
+
+void vendor_clearAction(void)
+{
+	pending_action = ACTION_NONE;
+}
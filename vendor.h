@@ -0,0 +1,126 @@
+#ifndef _vendor_h__
+#define _vendor_h__
+
+#include "usbdrv.h"
+
+/* Vendor specific control requests on endpoint 0.
+ *
+ * Except for RQ_GET_VERSION, all requests must carry the protocol
+ * version in wIndex. Requests with another version are ignored
+ * (zero-length reply) so a newer tool cannot misinterpret data
+ * from an older firmware, or the opposite.
+ */
+#define VENDOR_PROTOCOL_VERSION	1
+
+/* IN. Returns 3 bytes: Protocol version, sizeof(Config), sizeof(Stats) */
+#define RQ_GET_VERSION		0x00
+
+/* IN. Returns the current configuration (see config.h) */
+#define RQ_GET_CONFIG		0x01
+
+/* OUT. Replace the configuration. wLength must be sizeof(Config).
+ * Stalls if a setting is out of range (see config_set()). */
+#define RQ_SET_CONFIG		0x02
+
+/* IN. Returns the counters and timing statistics (see stats.h) */
+#define RQ_GET_STATS		0x03
+
+/* No data. Reset the counters and timing statistics, except reset_cause. */
+#define RQ_RESET_STATS		0x04
+
+/* No data. Request an action. wValue low byte: Action, high byte: argument.
+ * Actions are executed from the main loop. They are discarded when no
+ * controller is present. */
+#define RQ_ACTION			0x05
+
+/* No data. Write the current configuration to EEPROM. */
+#define RQ_SAVE_CONFIG		0x06
+
+/* No data. Restore the default configuration. (Not saved) */
+#define RQ_DEFAULT_CONFIG	0x07
+
+/* IN. Returns the serial number (SERIALNO_LENGTH characters) */
+#define RQ_GET_SERIAL		0x08
+
+/* OUT. Assign a serial number (SERIALNO_LENGTH characters, 0-9 and A-Z).
+ * Saved to EEPROM and used from the next enumeration. */
+#define RQ_SET_SERIAL		0x09
+
+/* IN. Returns the input history entries, oldest first (see history.h).
+ * Recording is suspended until all the entries have been read. */
+#define RQ_GET_HISTORY		0x0A
+
+/* IN. Returns the button and axis remap table (see remap.h) of the
+ * controller type in wValue (REMAP_GAMECUBE, REMAP_N64). */
+#define RQ_GET_REMAP		0x0B
+
+/* OUT. Store a remap table (sizeof(RemapTable)) for the controller type in
+ * wValue. Saved to EEPROM and used right away. Stalls if the table is invalid. */
+#define RQ_SET_REMAP		0x0C
+
+/* No data. Restore and save the default remap table for the controller
+ * type in wValue. */
+#define RQ_DEFAULT_REMAP	0x0D
+
+/* IN. Read the N64 Controller Pak, starting at the address in wValue.
+ * The address and wLength must be multiples of 32, up to N64_PAK_SIZE.
+ * A transfer ending early indicates a read error. Like the other pak
+ * requests, ignored when no N64 controller is connected. */
+#define RQ_PAK_READ			0x0E
+
+/* OUT. Write the N64 Controller Pak, starting at the address in wValue.
+ * The address and wLength must be multiples of 32, up to N64_PAK_SIZE.
+ * Stalls on write errors. */
+#define RQ_PAK_WRITE		0x0F
+
+/* No data. Power the N64 Transfer Pak on (wValue 1) or off (wValue 0).
+ * This takes several pak transactions and is done from the main loop.
+ * Poll RQ_TPAK_STATUS for the result. */
+#define RQ_TPAK_POWER		0x10
+
+/* IN. Read the Game Boy cartridge in the Transfer Pak, starting at the
+ * cartridge address in wValue. The address and wLength must be multiples
+ * of 32, up to 0x10000. A transfer ending early indicates a read error.
+ * To check the setup, read the cartridge header: 0x0100, 96 bytes. The
+ * logo at 0x0104 and the header checksum at 0x014D can be verified. */
+#define RQ_TPAK_READ		0x11
+
+/* OUT. Write to the Game Boy cartridge in the Transfer Pak (cartridge RAM,
+ * or MBC registers for bank switching), starting at the cartridge address
+ * in wValue. Same constraints as RQ_TPAK_READ. Stalls on write errors. */
+#define RQ_TPAK_WRITE		0x12
+
+/* IN. Returns the execution time profile: PROF_NUM_COUNTERS ProfCounter
+ * records (see stats.h), in PROF_* order. Little endian. Zero-length
+ * reply when the firmware was built without WITH_PROFILING. Reset with
+ * RQ_RESET_STATS. */
+#define RQ_GET_PROFILE		0x13
+
+/* IN. Returns 2 bytes about the last RQ_TPAK_POWER: The result (N64_PAK_OK,
+ * an N64_PAK_ERR_* code from n64_pak.h, or TPAK_RESULT_*), and when
+ * powered on successfully, the transfer pak status register. */
+#define RQ_TPAK_STATUS		0x14
+
+#define TPAK_RESULT_PENDING	0xff // Not done yet
+#define TPAK_RESULT_NONE	0xfe // No RQ_TPAK_POWER since startup
+
+/* Actions */
+#define ACTION_NONE			0x00
+#define ACTION_RECALIBRATE	0x01 // Re-initialize the controller
+#define ACTION_RUMBLE_TEST	0x02 // Vibrate for (argument) effect loop ticks (~22ms)
+
+/* n64_pad: Non-zero when the current controller is an N64 controller.
+ * Pak requests are ignored otherwise. */
+usbMsgLen_t vendor_setup(usbRequest_t *rq, unsigned char n64_pad);
+uchar vendor_read(uchar *data, uchar len);
+uchar vendor_write(uchar *data, uchar len);
+
+/* Work done outside USB transfers (reading ahead). Call from the main loop. */
+void vendor_doTasks(void);
+
+/* Returns the pending action (ACTION_*) and clears it. */
+unsigned char vendor_getAction(unsigned char *arg);
+void vendor_clearAction(void);
+
+#endif // _vendor_h__
+